@@ -0,0 +1,199 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                     File: command_bench.c                    *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Benchmark for applying server messages to the game state, decoding
+// included. Runs a stream of messages one at a time with run_message, and
+// in batches with run_commands (the way a frame drains the queue, where
+// superseded positions are skipped).
+//
+// Usage: command_bench [recording [batch]]
+// recording is a file of server messages, one per line, or - to generate a
+// stream with the same mix of commands as a busy game. batch is the number
+// of messages run together (64 by default).
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "commands.h"
+#include "game.h"
+
+// Lines in a generated stream
+#define LINE_COUNT 1000000
+// Times each mode runs over the stream. The fastest run is reported.
+#define RUNS 5
+// Rooms in the generated messages. The state is reset to a house of the
+// default size.
+#define ROOM_COUNT (HOUSE_W * HOUSE_H)
+
+// Seconds from a clock for timing
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Random position on the screen, written the way Python writes floats
+static double randomPosition(void) { return rand() % 120000 / 100.0; }
+
+// Generate a stream of server messages. Mostly positions and acks, like a
+// game where both players are moving.
+static char *generateStream(size_t *length) {
+    size_t capacity = (size_t)LINE_COUNT * 48;
+    char *stream = (char *)malloc(capacity + 1);
+    size_t used = 0;
+    // Trap IDs placed and set off so far
+    int placed = 0;
+    int activated = 0;
+
+    srand(1);
+    for (int i = 0; i < LINE_COUNT; i++) {
+        char *out = stream + used;
+        int left = (int)(capacity - used);
+        int kind = rand() % 100;
+        double x = randomPosition();
+        double y = randomPosition();
+
+        if (kind < 55) {
+            used += snprintf(out, left, "P,1,%.10g,%.10g,%d\n", x, y, i * 16);
+        } else if (kind < 80) {
+            used += snprintf(out, left, "Q,%d,%.10g,%.10g,%d\n", i, x, y,
+                             rand() % ROOM_COUNT);
+        } else if (kind < 90) {
+            used += snprintf(out, left, "F,1,%d\n", rand() % 4);
+        } else if (kind < 94) {
+            used += snprintf(out, left, "R,1,%d\n", rand() % ROOM_COUNT);
+        } else if (kind < 98) {
+            // Up to 6 traps are placed at once (3 per player), and they're
+            // set off in the order they were placed
+            if (placed - activated < 6 && (kind % 2 || activated == placed)) {
+                used += snprintf(out, left, "T,1,%d,%d,%.10g,%.10g,%d\n",
+                                 rand() % TRAP_COUNT + 1, rand() % ROOM_COUNT,
+                                 x, y, placed++ % 65536);
+            } else {
+                used += snprintf(out, left, "A,%d\n", activated++ % 65536);
+            }
+        } else if (kind < 99) {
+            used += snprintf(out, left, "I,1,%d,%d\n", rand() % FURNITURE_MAX,
+                             rand() % FOOD_COUNT);
+        } else {
+            used += snprintf(out, left, "C,20.0\n");
+        }
+    }
+
+    stream[used] = '\0';
+    *length = used;
+    return stream;
+}
+
+// Read a recorded stream
+static char *readStream(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *stream = (char *)malloc(size + 1);
+    *length = fread(stream, 1, size, file);
+    stream[*length] = '\0';
+    fclose(file);
+    return stream;
+}
+
+// Start a game without loading the level, which isn't needed to apply
+// commands
+static void resetState(GameState *state) {
+    memset(state, 0, sizeof(GameState));
+    state->thisPlayer = 0;
+    state->houseW = HOUSE_W;
+    state->houseH = HOUSE_H;
+    // Every furniture slot the stream names exists
+    state->furniture.count = FURNITURE_MAX;
+}
+
+// Print the result of one mode
+static void report(const char *name, long messages, double best) {
+    printf("%-22s %8.1f ms  %6.1f ns/message  %6.2f M messages/s\n", name,
+           best * 1000.0, best * 1e9 / messages, messages / best / 1e6);
+}
+
+int main(int argc, char **argv) {
+    size_t length;
+    char *stream = argc > 1 && strcmp(argv[1], "-") != 0
+                       ? readStream(argv[1], &length)
+                       : generateStream(&length);
+    int batchSize = argc > 2 ? atoi(argv[2]) : 64;
+    if (batchSize < 1) batchSize = 1;
+
+    // Batches are made by ending the stream after every batchSize lines, so
+    // run_commands stops there
+    char *batched = (char *)malloc(length + 1);
+    memcpy(batched, stream, length + 1);
+    long messages = 0;
+    long batches = 1;
+    for (size_t i = 0; i < length; i++) {
+        if (batched[i] == '\n' && ++messages % batchSize == 0) {
+            batched[i] = '\0';
+            batches++;
+        }
+    }
+
+    GameState *state = (GameState *)malloc(sizeof(GameState));
+    double singleBest = 1e9;
+    double batchBest = 1e9;
+    long failures = 0;
+
+    for (int run = 0; run < RUNS; run++) {
+        // One message at a time
+        resetState(state);
+        failures = 0;
+        double start = now();
+        const char *end = stream + length;
+        for (const char *line = stream; line < end;) {
+            const char *newline = memchr(line, '\n', end - line);
+            const char *next = newline ? newline : end;
+            if (next != line) {
+                ClientMessage message = {(char *)line, (int)(next - line),
+                                         PROTOCOL_TEXT};
+                failures += run_message(&message, state);
+            }
+            line = next + 1;
+        }
+        double elapsed = now() - start;
+        if (elapsed < singleBest) singleBest = elapsed;
+
+        // In batches
+        resetState(state);
+        start = now();
+        char *batchEnd = batched + length;
+        for (char *batch = batched; batch < batchEnd;) {
+            size_t batchLength = strlen(batch);
+            run_commands(batch, state);
+            batch += batchLength + 1;
+        }
+        elapsed = now() - start;
+        if (elapsed < batchBest) batchBest = elapsed;
+    }
+
+    printf("%ld messages, %.1f MB, %ld batches of %d, %ld not applied\n",
+           messages, length / 1e6, batches, batchSize, failures);
+    report("run_message:", messages, singleBest);
+    report("run_commands batches:", messages, batchBest);
+
+    free(state);
+    free(batched);
+    free(stream);
+    return 0;
+}
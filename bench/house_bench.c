@@ -0,0 +1,187 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                      File: house_bench.c                     *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Benchmark for the cost of a tick in houses of different sizes. The player
+// walks a loop through four rooms in the middle of the house, searching
+// every tick, with half of the traps and a few pieces of furniture in those
+// rooms and the rest spread over the rest of the house. The loop is the
+// same in every house, so a tick should cost the same however many rooms
+// there are.
+//
+// Usage: house_bench [loops]
+// loops is the number of times the player walks the loop in each run (25
+// by default, 10000 ticks).
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "client.h"
+#include "game.h"
+
+// Ticks spent walking each way. Long enough to go through one door.
+#define SIDEWAYS_TICKS 120
+#define UPDOWN_TICKS 80
+#define LOOP_TICKS (2 * SIDEWAYS_TICKS + 2 * UPDOWN_TICKS)
+// Furniture in each room of the loop
+#define LOOP_FURNITURE 3
+// Times each house is run. The fastest run is reported.
+#define RUNS 5
+
+// Seconds from a clock for timing
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Random coordinate in a room
+static float randomX(void) { return rand() % (SCREEN_W * 100) / 100.0f; }
+static float randomY(void) { return rand() % (SCREEN_H * 100) / 100.0f; }
+
+// The four rooms of the loop: top left, top right, bottom right, bottom
+// left, in the middle of the house
+static void loopRooms(const GameState *state, int rooms[4]) {
+    int column = (state->houseW - 2) / 2;
+    int row = (state->houseH - 2) / 2;
+    rooms[0] = row * state->houseW + column;
+    rooms[1] = rooms[0] + 1;
+    rooms[2] = rooms[1] + state->houseW;
+    rooms[3] = rooms[0] + state->houseW;
+}
+
+// Random room that isn't in the loop, or one that is if the loop is the
+// whole house
+static int randomOtherRoom(const GameState *state, const int loop[4]) {
+    for (int tries = 0; tries < 100; tries++) {
+        int room = rand() % houseRooms(state);
+        if (room != loop[0] && room != loop[1] && room != loop[2] &&
+            room != loop[3]) {
+            return room;
+        }
+    }
+    return loop[rand() % 4];
+}
+
+// Start a game in a house without loading the level. Everything is placed
+// the same way whatever the size, so each house gets the same loop.
+static void resetState(GameState *state, int houseW, int houseH) {
+    memset(state, 0, sizeof(GameState));
+    state->houseW = houseW;
+    state->houseH = houseH;
+    setTickRate(state, 60);
+    memset(state->trapInventory, true, sizeof(state->trapInventory));
+    state->positionPolicy.epsilon = 0.5f;
+    state->positionPolicy.heartbeat = 1.0;
+
+    int loop[4];
+    loopRooms(state, loop);
+    srand(1);
+
+    // Same search areas as gamestate_new
+    state->furnitureAreas[0] = (Area){{150, 350}, 300};
+    state->furnitureAreas[1] = (Area){{530, 295}, 300};
+    state->furnitureAreas[2] = (Area){{1090, 75}, 200};
+    FurnitureTable *furniture = &state->furniture;
+    for (int i = 0; i < FURNITURE_MAX; i++) {
+        furniture->data[i] = (FurnitureData)(i % FURNITURE_COUNT + 1);
+        furniture->food[i] = (FoodData)(i % FOOD_COUNT + 1);
+        furniture->room[i] = i < 4 * LOOP_FURNITURE
+                                 ? loop[i / LOOP_FURNITURE]
+                                 : randomOtherRoom(state, loop);
+    }
+    furniture->count = FURNITURE_MAX;
+    indexFurniture(state);
+
+    // Traps belong to this player, so walking over them sets nothing off
+    for (int i = 0; i < TRAP_MAX; i++) {
+        int room = i % 2 ? loop[i / 2 % 4] : randomOtherRoom(state, loop);
+        trapTableAdd(&state->traps, i, i % TRAP_COUNT + 1, 0, room,
+                     randomX(), randomY());
+    }
+
+    for (int i = 0; i < 2; i++) {
+        state->players[i].room = loop[0];
+        state->players[i].pos = (Position){SCREEN_W / 2.0f, SCREEN_H / 2.0f};
+        state->players[i].health = 100.0f;
+    }
+}
+
+// Walk the loop, and return how many doors were gone through
+static long walkLoops(Client *client, GameState *state, int loops) {
+    Player *player = &state->players[0];
+    Player *other = &state->players[1];
+    int start = player->room;
+    long doors = 0;
+
+    for (int loop = 0; loop < loops; loop++) {
+        // Start from the same place every time
+        player->room = start;
+        player->pos = (Position){SCREEN_W / 2.0f, SCREEN_H / 2.0f};
+
+        for (int tick = 0; tick < LOOP_TICKS; tick++) {
+            int input = tick < SIDEWAYS_TICKS                   ? INPUT_RIGHT
+                        : tick < SIDEWAYS_TICKS + UPDOWN_TICKS  ? INPUT_DOWN
+                        : tick < 2 * SIDEWAYS_TICKS + UPDOWN_TICKS
+                            ? INPUT_LEFT
+                            : INPUT_UP;
+            int room = player->room;
+            onAction(client, state, ACTION_SEARCH, player, other);
+            runGameLogic(client, state, player, other, input,
+                         state->tickLength);
+            interpolatePlayers(state);
+            doors += player->room != room;
+        }
+    }
+    return doors;
+}
+
+int main(int argc, char **argv) {
+    int loops = argc > 1 ? atoi(argv[1]) : 25;
+    if (loops <= 0) {
+        fprintf(stderr, "Usage: %s [loops]\n", argv[0]);
+        return 1;
+    }
+
+    // Houses from the default one to the largest the room file allows
+    static const int sizes[][2] = {
+        {HOUSE_W, HOUSE_H}, {10, 10}, {100, 100}, {HOUSE_MAX, HOUSE_MAX}};
+    int sizeCount = (int)(sizeof(sizes) / sizeof(sizes[0]));
+
+    // Never connected, so everything the game sends is dropped
+    Client *client = clientInit();
+    GameState *state = (GameState *)malloc(sizeof(GameState));
+    long ticks = (long)loops * LOOP_TICKS;
+    printf("%ld ticks a run, %zu byte game state\n", ticks, sizeof(GameState));
+
+    int failed = 0;
+    for (int s = 0; s < sizeCount; s++) {
+        double best = 1e9;
+        long doors = 0;
+        for (int run = 0; run < RUNS; run++) {
+            resetState(state, sizes[s][0], sizes[s][1]);
+            double start = now();
+            doors = walkLoops(client, state, loops);
+            double elapsed = now() - start;
+            if (elapsed < best) best = elapsed;
+        }
+
+        // Each loop goes through four doors, in every house
+        failed |= doors != 4L * loops;
+        printf("%3dx%-3d %6d rooms  %8.3f ms  %7.1f ns/tick  %ld doors\n",
+               sizes[s][0], sizes[s][1], sizes[s][0] * sizes[s][1],
+               best * 1000.0, best * 1e9 / ticks, doors);
+    }
+
+    free(state);
+    clientFree(client);
+    return failed;
+}
@@ -0,0 +1,236 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                      File: parse_bench.c                     *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Benchmark for the text protocol parser. Compares decodeCommand against
+// the sscanf cascade it replaced, on a million lines of server messages.
+//
+// Usage: parse_bench [recording]
+// recording is a file of server messages, one per line (for example the
+// server's output captured with tcpdump). Without it, a stream with the
+// same mix of commands as a busy game is generated.
+
+// Includes
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "protocol.h"
+
+// Lines in a generated stream
+#define LINE_COUNT 1000000
+// Times each parser runs over the stream. The fastest run is reported.
+#define RUNS 5
+
+// The parser from before decodeCommand, one sscanf per pattern until one
+// matches. line must be null-terminated.
+static bool legacyDecode(const char *line, Command *command) {
+    memset(command, 0, sizeof(Command));
+    unsigned time;
+    int scanned = sscanf(line, "P,%d,%f,%f,%u", &command->player,
+                         &command->x, &command->y, &time);
+    if (scanned >= 3) {
+        command->type = COMMAND_POSITION;
+        command->time = scanned == 4 ? time / 1000.0 : -1.0;
+    } else if (sscanf(line, "R,%d,%d", &command->player, &command->room) ==
+               2) {
+        command->type = COMMAND_ROOM;
+    } else if (sscanf(line, "T,%d,%d,%d,%f,%f,%d", &command->player,
+                      &command->trapData, &command->room, &command->x,
+                      &command->y, &command->trap) == 6) {
+        command->type = COMMAND_TRAP;
+    } else if (sscanf(line, "K,%100[^\n]", command->reason) == 1) {
+        command->type = COMMAND_KICK;
+    } else if (sscanf(line, "I,%d,%d,%d", &command->player,
+                      &command->furniture, &command->item) == 3) {
+        command->type = COMMAND_ITEM;
+    } else if (sscanf(line, "C,%f", &command->damage) == 1) {
+        command->type = COMMAND_ATTACK;
+    } else if (sscanf(line, "O,%d", &command->player) == 1) {
+        command->type = COMMAND_GAMEOVER;
+    } else if (sscanf(line, "F,%d,%d", &command->player, &command->facing) ==
+               2) {
+        command->type = COMMAND_FACING;
+    } else if (sscanf(line, "A,%d", &command->trap) == 1) {
+        command->type = COMMAND_TRAPACTIVATED;
+    } else if (sscanf(line, "Q,%u,%f,%f,%d", &command->sequence, &command->x,
+                      &command->y, &command->room) == 4) {
+        command->type = COMMAND_INPUTACK;
+    } else if (sscanf(line, "H,%u", &command->sequence) == 1) {
+        command->type = COMMAND_PONG;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Seconds from a clock for timing
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Random position, written the way Python writes floats
+static int randomPosition(char *out, int size) {
+    return snprintf(out, size, "%.10g", rand() % 120000 / 100.0);
+}
+
+// Generate a stream of server messages. Mostly positions and acks, like a
+// game where both players are moving.
+static char *generateStream(size_t *length) {
+    size_t capacity = (size_t)LINE_COUNT * 48;
+    char *stream = (char *)malloc(capacity);
+    size_t used = 0;
+    char x[32], y[32];
+
+    srand(1);
+    for (int i = 0; i < LINE_COUNT; i++) {
+        char *out = stream + used;
+        int left = (int)(capacity - used);
+        int kind = rand() % 100;
+        randomPosition(x, sizeof(x));
+        randomPosition(y, sizeof(y));
+
+        if (kind < 55) {
+            used += snprintf(out, left, "P,%d,%s,%s,%d\n", rand() % 2, x, y,
+                             i * 16);
+        } else if (kind < 80) {
+            used += snprintf(out, left, "Q,%d,%s,%s,%d\n", i, x, y,
+                             rand() % 6);
+        } else if (kind < 88) {
+            used += snprintf(out, left, "F,%d,%d\n", rand() % 2, rand() % 4);
+        } else if (kind < 92) {
+            used += snprintf(out, left, "R,%d,%d\n", rand() % 2, rand() % 6);
+        } else if (kind < 94) {
+            used += snprintf(out, left, "T,%d,%d,%d,%s,%s,%d\n", rand() % 2,
+                             rand() % 3 + 1, rand() % 6, x, y, i % 65536);
+        } else if (kind < 96) {
+            used += snprintf(out, left, "I,%d,%d,%d\n", rand() % 2,
+                             rand() % 100, rand() % 5);
+        } else if (kind < 97) {
+            used += snprintf(out, left, "C,20.0\n");
+        } else if (kind < 98) {
+            used += snprintf(out, left, "A,%d\n", rand() % 100);
+        } else {
+            used += snprintf(out, left, "H,%d\n", i);
+        }
+    }
+
+    *length = used;
+    return stream;
+}
+
+// Read a recorded stream
+static char *readStream(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *stream = (char *)malloc(size + 1);
+    *length = fread(stream, 1, size, file);
+    fclose(file);
+    return stream;
+}
+
+// Check that two decoded commands carry the same values
+static bool sameCommand(const Command *a, const Command *b) {
+    return a->type == b->type && a->player == b->player &&
+           a->room == b->room && fabsf(a->x - b->x) < 1e-3f &&
+           fabsf(a->y - b->y) < 1e-3f && a->trapData == b->trapData &&
+           a->trap == b->trap && a->facing == b->facing &&
+           a->furniture == b->furniture && a->item == b->item &&
+           fabsf(a->damage - b->damage) < 1e-3f &&
+           a->sequence == b->sequence && a->time == b->time &&
+           strcmp(a->reason, b->reason) == 0;
+}
+
+int main(int argc, char **argv) {
+    size_t length;
+    char *stream = argc > 1 ? readStream(argv[1], &length)
+                            : generateStream(&length);
+
+    // The legacy parser tokenized the stream in place with strtok_r, so it
+    // runs on a copy
+    char *copy = (char *)malloc(length + 1);
+    double legacyBest = 1e9;
+    double newBest = 1e9;
+    long lines = 0;
+    long failures = 0;
+    Command command;
+
+    for (int run = 0; run < RUNS; run++) {
+        memcpy(copy, stream, length);
+        copy[length] = '\0';
+
+        double start = now();
+        long count = 0;
+        char *key;
+        for (char *line = strtok_r(copy, "\n", &key); line;
+             line = strtok_r(NULL, "\n", &key)) {
+            count += legacyDecode(line, &command);
+        }
+        double elapsed = now() - start;
+        if (elapsed < legacyBest) legacyBest = elapsed;
+
+        start = now();
+        count = 0;
+        lines = 0;
+        const char *end = stream + length;
+        for (const char *line = stream; line < end;) {
+            const char *newline = memchr(line, '\n', end - line);
+            const char *next = newline ? newline : end;
+            if (next != line) {
+                count += decodeCommand(line, (int)(next - line),
+                                       PROTOCOL_TEXT, &command);
+                lines++;
+            }
+            line = next + 1;
+        }
+        elapsed = now() - start;
+        if (elapsed < newBest) newBest = elapsed;
+        failures = lines - count;
+    }
+
+    // Both parsers have to agree on every line
+    long mismatches = 0;
+    memcpy(copy, stream, length);
+    copy[length] = '\0';
+    char *key;
+    for (char *line = strtok_r(copy, "\n", &key); line;
+         line = strtok_r(NULL, "\n", &key)) {
+        Command legacy;
+        bool legacyOk = legacyDecode(line, &legacy);
+        bool newOk = decodeCommand(line, (int)strlen(line), PROTOCOL_TEXT,
+                                   &command);
+        if (legacyOk != newOk || (newOk && !sameCommand(&legacy, &command))) {
+            if (mismatches < 5) printf("Mismatch: %s\n", line);
+            mismatches++;
+        }
+    }
+
+    printf("%ld lines, %.1f MB, %ld not decoded\n", lines, length / 1e6,
+           failures);
+    printf("sscanf cascade: %8.1f ms  %6.1f ns/line\n", legacyBest * 1000.0,
+           legacyBest * 1e9 / lines);
+    printf("decodeCommand:  %8.1f ms  %6.1f ns/line\n", newBest * 1000.0,
+           newBest * 1e9 / lines);
+    printf("speedup: %.1fx, %ld mismatches\n", legacyBest / newBest,
+           mismatches);
+
+    free(copy);
+    free(stream);
+    return mismatches != 0;
+}
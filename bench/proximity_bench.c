@@ -0,0 +1,160 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                    File: proximity_bench.c                   *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Benchmark for the proximity checks. Compares proximityQuery against the
+// loop it replaced (powf and sqrtf per point) and a plain loop over squared
+// distances, on a room full of points, and checks they all agree.
+//
+// Usage: proximity_bench [points]
+// points is the number of points in the room (1024 by default, the most
+// traps there can be).
+
+// Includes
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "proximity.h"
+
+// Player positions each method is run against
+#define QUERY_COUNT 4096
+// Times each method runs over the queries. The fastest run is reported.
+#define RUNS 5
+// Same as the trap radius in the game
+#define RADIUS 80.0f
+
+// Seconds from a clock for timing
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Random coordinate on the screen
+static float randomCoordinate(void) { return rand() % 120000 / 100.0f; }
+
+// The distance check from before proximityQuery, one point at a time
+static int legacyQuery(const float *xs, const float *ys, int count, float x,
+                       float y, float radius, uint32_t *hits) {
+    int hitCount = 0;
+    for (int i = 0; i < PROXIMITY_WORDS(count); i++) hits[i] = 0;
+    for (int i = 0; i < count; i++) {
+        float distance = sqrtf(powf(xs[i] - x, 2.0f) + powf(ys[i] - y, 2.0f));
+        if (distance <= radius) {
+            hits[i / 32] |= 1u << (i % 32);
+            hitCount++;
+        }
+    }
+    return hitCount;
+}
+
+// Squared distances, one point at a time
+static int scalarQuery(const float *xs, const float *ys, int count, float x,
+                       float y, float radius, uint32_t *hits) {
+    int hitCount = 0;
+    for (int i = 0; i < PROXIMITY_WORDS(count); i++) hits[i] = 0;
+    for (int i = 0; i < count; i++) {
+        float dx = xs[i] - x;
+        float dy = ys[i] - y;
+        if (dx * dx + dy * dy <= radius * radius) {
+            hits[i / 32] |= 1u << (i % 32);
+            hitCount++;
+        }
+    }
+    return hitCount;
+}
+
+typedef int (*Query)(const float *, const float *, int, float, float, float,
+                     uint32_t *);
+
+// Run a method over every query, and return the fastest run. The hits are
+// added up into total, so the work can't be skipped.
+static double timeQuery(Query query, const float *xs, const float *ys,
+                        int count, const float *queryX, const float *queryY,
+                        uint32_t *hits, long *total) {
+    double best = 1e9;
+    for (int run = 0; run < RUNS; run++) {
+        *total = 0;
+        double start = now();
+        for (int q = 0; q < QUERY_COUNT; q++) {
+            *total += query(xs, ys, count, queryX[q], queryY[q], RADIUS, hits);
+        }
+        double elapsed = now() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// Print the timing for a method
+static void report(const char *name, int count, double best) {
+    printf("%-16s %8.3f ms  %7.1f ns/query  %5.2f ns/point\n", name,
+           best * 1000.0, best * 1e9 / QUERY_COUNT,
+           best * 1e9 / QUERY_COUNT / count);
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 1024;
+    if (count <= 0) {
+        fprintf(stderr, "Usage: %s [points]\n", argv[0]);
+        return 1;
+    }
+
+    float *xs = (float *)malloc(count * sizeof(float));
+    float *ys = (float *)malloc(count * sizeof(float));
+    float *queryX = (float *)malloc(QUERY_COUNT * sizeof(float));
+    float *queryY = (float *)malloc(QUERY_COUNT * sizeof(float));
+    int words = PROXIMITY_WORDS(count);
+    uint32_t *hits = (uint32_t *)malloc(words * sizeof(uint32_t));
+    uint32_t *expected = (uint32_t *)malloc(words * sizeof(uint32_t));
+
+    srand(1);
+    for (int i = 0; i < count; i++) {
+        xs[i] = randomCoordinate();
+        ys[i] = randomCoordinate();
+    }
+    for (int q = 0; q < QUERY_COUNT; q++) {
+        queryX[q] = randomCoordinate();
+        queryY[q] = randomCoordinate();
+    }
+
+    // Every method has to find the same points
+    long mismatches = 0;
+    for (int q = 0; q < QUERY_COUNT; q++) {
+        scalarQuery(xs, ys, count, queryX[q], queryY[q], RADIUS, expected);
+        proximityQuery(xs, ys, count, queryX[q], queryY[q], RADIUS, hits);
+        for (int i = 0; i < words; i++) mismatches += hits[i] != expected[i];
+        legacyQuery(xs, ys, count, queryX[q], queryY[q], RADIUS, hits);
+        for (int i = 0; i < words; i++) mismatches += hits[i] != expected[i];
+    }
+
+    long legacyTotal, scalarTotal, kernelTotal;
+    double legacyBest = timeQuery(legacyQuery, xs, ys, count, queryX, queryY,
+                                  hits, &legacyTotal);
+    double scalarBest = timeQuery(scalarQuery, xs, ys, count, queryX, queryY,
+                                  hits, &scalarTotal);
+    double kernelBest = timeQuery(proximityQuery, xs, ys, count, queryX,
+                                  queryY, hits, &kernelTotal);
+
+    printf("%d points, %d queries, %ld hits, %ld mismatched words\n", count,
+           QUERY_COUNT, kernelTotal, mismatches);
+    report("powf and sqrtf:", count, legacyBest);
+    report("squared:", count, scalarBest);
+    report("proximityQuery:", count, kernelBest);
+
+    free(expected);
+    free(hits);
+    free(queryY);
+    free(queryX);
+    free(ys);
+    free(xs);
+    return mismatches != 0 || legacyTotal != kernelTotal ||
+           scalarTotal != kernelTotal;
+}
@@ -0,0 +1,454 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                          File: bot.c                         *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Headless bots, for putting load on a server. Each bot is a full client:
+// it joins a lobby with the real protocol and runs the game logic from
+// svs_core, but its keys are pressed by a behaviour profile instead of a
+// player. Every bot runs on one thread, woken by a NetPoller when its
+// sockets have data, so one process can run hundreds of them.
+//
+// Usage: bot [options] [hostname]
+//   -n count     bots to run (2 by default). Two bots share each lobby.
+//   -l lobby     first lobby to join (1000 by default)
+//   -p profile   wander, trapper, hunter, forager, or mixed to give each
+//                bot the next profile in turn (the default)
+//   -t seconds   how long to run, or 0 until every game ends (60 by
+//                default)
+//   -s seed      random seed, so a run can be repeated (1 by default)
+//   -f features  FEATURE_* bits to ask the server for (all by default)
+//   -r file      record a replay of the first bot (see replay.h)
+// hostname is localhost by default. Run from bin/, since the level is read
+// from room.txt. Each bot has two sockets, so more than a few hundred need
+// a higher open file limit (ulimit -n).
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "client.h"
+#include "commands.h"
+#include "game.h"
+#include "replay.h"
+
+// Port the server listens on
+#define BOT_PORT 3490
+// Frames a second, the same as the game's timer
+#define FRAME_RATE 60
+// Seconds between status lines
+#define STATUS_INTERVAL 5.0
+// Closest a bot gets to where it's going before picking somewhere else
+#define ARRIVE_DISTANCE 8.0f
+
+// How a bot plays. Rates are average times a second.
+typedef struct {
+    const char *name;
+    // Picking a new place to go before getting to the last one
+    double wanderRate;
+    // Key presses
+    double trapRate;
+    double searchRate;
+    double attackRate;
+    // Go after the other player when they're in the same room
+    bool chase;
+    // Go to furniture that has food, rather than anywhere
+    bool forage;
+} BotProfile;
+
+static const BotProfile profiles[] = {
+    {"wander", 0.5, 0.05, 0.5, 0.2, false, false},
+    {"trapper", 0.3, 0.5, 0.2, 0.2, false, false},
+    {"hunter", 0.3, 0.05, 0.1, 4.0, true, false},
+    {"forager", 0.2, 0.05, 2.0, 0.2, false, true},
+};
+#define PROFILE_COUNT (int)(sizeof(profiles) / sizeof(profiles[0]))
+
+// One bot and its connection
+typedef struct {
+    Client *client;
+    GameState *state;
+    const BotProfile *profile;
+    // Random number state, so every bot has its own repeatable stream
+    unsigned int random;
+    // Where the bot is walking to, and in which room
+    Position target;
+    int targetRoom;
+    MoveInput input;
+    // Set when the game ended, the bot was kicked, or the connection
+    // closed
+    bool done;
+} Bot;
+
+// Random number from a bot's stream (xorshift)
+static unsigned int botRandom(Bot *bot) {
+    unsigned int x = bot->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    bot->random = x;
+    return x;
+}
+
+// Random number from 0 up to but not including 1
+static double botUniform(Bot *bot) {
+    return (botRandom(bot) >> 8) / (double)(1u << 24);
+}
+
+// Check if something that happens rate times a second happens this frame
+static bool botChance(Bot *bot, double rate, double dt) {
+    return botUniform(bot) < rate * dt;
+}
+
+// Pick a point on one of the room's doors
+static Position pickDoor(Bot *bot, int room) {
+    // Only sides with a room behind them
+    int doors[4];
+    int count = 0;
+    for (int door = 1; door <= 4; door++) {
+        if (roomThroughDoor(bot->state, room, door) >= 0) {
+            doors[count++] = door;
+        }
+    }
+
+    Position door = {botUniform(bot) * SCREEN_W, botUniform(bot) * SCREEN_H};
+    // A house of one room has no doors, so anywhere will do
+    if (count == 0) {
+        return door;
+    }
+    switch (doors[botRandom(bot) % count]) {
+        case 1:
+            door.x = 0;
+            break;
+        case 2:
+            door.x = SCREEN_W;
+            break;
+        case 3:
+            door.y = 0;
+            break;
+        default:
+            door.y = SCREEN_H;
+            break;
+    }
+    return door;
+}
+
+// Pick the next place to go
+static void pickTarget(Bot *bot, Player *player) {
+    const FurnitureTable *furniture = &bot->state->furniture;
+    int room = player->room;
+    bot->targetRoom = room;
+
+    // Foragers go to furniture with food in this room, if there is any
+    int furnished = findFurnitureRoom(furniture, room);
+    if (bot->profile->forage && furnished >= 0 &&
+        furniture->roomFood[furnished] > 0) {
+        int start = furniture->roomStart[furnished];
+        int count = furniture->roomStart[furnished + 1] - start;
+        for (int tries = 0; tries < count; tries++) {
+            int i = furniture->roomFurniture[start + botRandom(bot) % count];
+            if (furniture->food[i] != FOOD_NONE) {
+                bot->target = furniture->area[i].pos;
+                return;
+            }
+        }
+    }
+
+    // Otherwise somewhere in the room, or through a door
+    if (botRandom(bot) % 2) {
+        bot->target = pickDoor(bot, room);
+    } else {
+        bot->target.x = botUniform(bot) * SCREEN_W;
+        bot->target.y = botUniform(bot) * SCREEN_H;
+    }
+}
+
+// Movement keys that take a player towards a point
+static int steer(Position from, Position to) {
+    int input = 0;
+    if (to.x < from.x - ARRIVE_DISTANCE / 2) input |= INPUT_LEFT;
+    if (to.x > from.x + ARRIVE_DISTANCE / 2) input |= INPUT_RIGHT;
+    if (to.y < from.y - ARRIVE_DISTANCE / 2) input |= INPUT_UP;
+    if (to.y > from.y + ARRIVE_DISTANCE / 2) input |= INPUT_DOWN;
+    return input;
+}
+
+// Decide what a bot does this frame, then run the game logic for it
+static void botFrame(Bot *bot, double dt) {
+    GameState *state = bot->state;
+    Player *player = &state->players[state->thisPlayer];
+    Player *other = &state->players[!state->thisPlayer];
+    const BotProfile *profile = bot->profile;
+
+    // Where to go. Hunters go for the other player when they can see them.
+    Position target = bot->target;
+    if (profile->chase && other->room == player->room) {
+        target = other->pos;
+    } else if (bot->targetRoom != player->room ||
+               distanceSquared(player->pos, target) <
+                   ARRIVE_DISTANCE * ARRIVE_DISTANCE ||
+               botChance(bot, profile->wanderRate, dt)) {
+        pickTarget(bot, player);
+        target = bot->target;
+    }
+
+    // Hold the keys towards it, the way a player would
+    int directions = steer(player->pos, target);
+    bot->input.pressed |= directions & ~bot->input.held;
+    bot->input.held = directions;
+
+    // Key presses. Actions that can't happen (no trap left, nothing to
+    // search, nobody in reach) do nothing, like in the game.
+    if (botChance(bot, profile->trapRate, dt)) {
+        Action trap = (Action)(ACTION_TRAP_CHEESE + botRandom(bot) % 3);
+        onAction(bot->client, state, trap, player, other);
+    }
+    if (botChance(bot, profile->searchRate, dt)) {
+        onAction(bot->client, state, ACTION_SEARCH, player, other);
+    }
+    if (botChance(bot, profile->attackRate, dt)) {
+        onAction(bot->client, state, ACTION_ATTACK, player, other);
+    }
+
+    runFrame(bot->client, state, player, other, &bot->input, dt);
+    if (state->done) {
+        bot->done = true;
+    }
+}
+
+// Stop a bot's sockets from waking the poller
+static void botStop(Bot *bot, NetPoller *poller) {
+    bot->done = true;
+    netPollerRemove(poller, bot->client->sockfd);
+    if (bot->client->udpfd != NET_INVALID_SOCKET) {
+        netPollerRemove(poller, bot->client->udpfd);
+    }
+}
+
+// Totals over every bot
+typedef struct {
+    TrafficCount sent;
+    TrafficCount recieved;
+    double rtt;
+    int rttCount;
+    int running;
+} BotTotals;
+
+static BotTotals botTotals(const Bot *bots, int count) {
+    BotTotals totals = {0};
+    for (int i = 0; i < count; i++) {
+        const NetStats *stats = &bots[i].client->stats;
+        TrafficCount sent = statsTotal(stats->sent);
+        TrafficCount recieved = statsTotal(stats->recieved);
+        totals.sent.messages += sent.messages;
+        totals.sent.bytes += sent.bytes;
+        totals.recieved.messages += recieved.messages;
+        totals.recieved.bytes += recieved.bytes;
+        if (stats->rttSmoothed > 0.0) {
+            totals.rtt += stats->rttSmoothed;
+            totals.rttCount++;
+        }
+        totals.running += !bots[i].done;
+    }
+    return totals;
+}
+
+// Print traffic since the last status line
+static void printStatus(const BotTotals *now, const BotTotals *last,
+                        double elapsed, double seconds, int count) {
+    printf("%7.1fs  %d/%d bots  sent %8.0f msg/s %8.1f kB/s  "
+           "recieved %8.0f msg/s %8.1f kB/s  rtt %.1f ms\n",
+           elapsed, now->running, count,
+           (now->sent.messages - last->sent.messages) / seconds,
+           (now->sent.bytes - last->sent.bytes) / seconds / 1000.0,
+           (now->recieved.messages - last->recieved.messages) / seconds,
+           (now->recieved.bytes - last->recieved.bytes) / seconds / 1000.0,
+           now->rttCount ? now->rtt / now->rttCount * 1000.0 : 0.0);
+}
+
+// Find a profile by name. Returns -1 for mixed, or -2 if there's none.
+static int findProfile(const char *name) {
+    if (strcmp(name, "mixed") == 0) return -1;
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        if (strcmp(name, profiles[i].name) == 0) return i;
+    }
+    return -2;
+}
+
+static int usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-n count] [-l lobby] [-p profile] [-t seconds] "
+            "[-s seed] [-f features] [-r file] [hostname]\n"
+            "Profiles: wander, trapper, hunter, forager, mixed\n",
+            program);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    int count = 2;
+    int firstLobby = 1000;
+    int profile = -1;
+    double duration = 60.0;
+    unsigned int seed = 1;
+    int features =
+        FEATURE_UDP | FEATURE_PREDICTION | FEATURE_PING | FEATURE_GAMESTATE;
+    char *hostname = "localhost";
+    char *replayPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            hostname = argv[i];
+            continue;
+        }
+        if (i + 1 >= argc) return usage(argv[0]);
+        const char *value = argv[++i];
+        switch (argv[i - 1][1]) {
+            case 'n':
+                count = atoi(value);
+                break;
+            case 'l':
+                firstLobby = atoi(value);
+                break;
+            case 'p':
+                profile = findProfile(value);
+                break;
+            case 't':
+                duration = atof(value);
+                break;
+            case 's':
+                seed = (unsigned int)strtoul(value, NULL, 10);
+                break;
+            case 'f':
+                features = atoi(value);
+                break;
+            case 'r':
+                replayPath = (char *)value;
+                break;
+            default:
+                return usage(argv[0]);
+        }
+    }
+    if (count <= 0 || firstLobby < 0 || profile == -2) {
+        return usage(argv[0]);
+    }
+
+    // Connect every bot and join its lobby
+    Bot *bots = (Bot *)calloc(count, sizeof(Bot));
+    NetPoller *poller = netPollerNew(2 * count);
+    if (!bots || !poller) {
+        fprintf(stderr, "Failed to allocate %d bots\n", count);
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        Bot *bot = &bots[i];
+        bot->profile = &profiles[profile >= 0 ? profile : i % PROFILE_COUNT];
+        // xorshift can't start from 0
+        bot->random = seed * 2654435761u + i * 40503u + 1;
+        bot->state = gamestate_new(i % 2, firstLobby + i / 2);
+        if (!bot->state) {
+            fprintf(stderr, "Failed to create game state\n");
+            return 1;
+        }
+
+        bot->client = clientInit();
+        bot->client->features = features;
+        if (clientConnect(bot->client, hostname, BOT_PORT) != 0) {
+            fprintf(stderr, "Failed to connect bot %d to %s\n", i, hostname);
+            return 1;
+        }
+        clientStartPolled(bot->client);
+        netPollerAdd(poller, bot->client->sockfd, bot);
+        if (bot->client->udpfd != NET_INVALID_SOCKET) {
+            netPollerAdd(poller, bot->client->udpfd, bot);
+        }
+
+        updateLobby(bot->client, bot->state);
+        clientFlush(bot->client);
+        bot->targetRoom = -1;
+    }
+    if (replayPath) {
+        bots[0].state->replay = replayRecord(replayPath, bots[0].state);
+    }
+
+    // Run every bot once a frame, and read from their sockets as data
+    // comes in between frames
+    void **ready = (void **)malloc(2 * count * sizeof(void *));
+    double frameLength = 1.0 / FRAME_RATE;
+    double start = netTime();
+    double lastFrame = start;
+    double nextFrame = start + frameLength;
+    double lastStatus = start;
+    BotTotals lastTotals = botTotals(bots, count);
+    long frames = 0;
+    int running = count;
+
+    while (running > 0) {
+        double now = netTime();
+        if (duration > 0.0 && now - start >= duration) break;
+
+        int timeout = nextFrame > now ? (int)((nextFrame - now) * 1000.0) : 0;
+        int readyCount = netPollerWait(poller, ready, 2 * count, timeout);
+        for (int i = 0; i < readyCount; i++) {
+            Bot *bot = (Bot *)ready[i];
+            // A bot with both sockets ready is listed twice
+            if (!bot->done && clientPump(bot->client) < 0) {
+                botStop(bot, poller);
+            }
+        }
+
+        now = netTime();
+        if (now < nextFrame) continue;
+        double dt = now - lastFrame;
+        lastFrame = now;
+        // Don't try to catch up after a stall, just carry on from now
+        nextFrame = now - nextFrame > frameLength ? now + frameLength
+                                                  : nextFrame + frameLength;
+        frames++;
+
+        running = 0;
+        for (int i = 0; i < count; i++) {
+            Bot *bot = &bots[i];
+            if (bot->done) continue;
+            botFrame(bot, dt);
+            if (bot->done) {
+                botStop(bot, poller);
+            } else {
+                running++;
+            }
+        }
+
+        if (now - lastStatus >= STATUS_INTERVAL) {
+            BotTotals totals = botTotals(bots, count);
+            printStatus(&totals, &lastTotals, now - start, now - lastStatus,
+                        count);
+            lastTotals = totals;
+            lastStatus = now;
+        }
+    }
+
+    // Totals for the whole run
+    double elapsed = netTime() - start;
+    BotTotals totals = botTotals(bots, count);
+    BotTotals none = {0};
+    printf("%d bots, %.1f s, %ld frames (%.1f a second)\n", count, elapsed,
+           frames, frames / elapsed);
+    printStatus(&totals, &none, elapsed, elapsed, count);
+
+    for (int i = 0; i < count; i++) {
+        if (bots[i].state->replay) {
+            replayClose(bots[i].state->replay);
+        }
+        clientStop(bots[i].client);
+        clientFree(bots[i].client);
+        free(bots[i].state);
+    }
+    netPollerFree(poller);
+    free(ready);
+    free(bots);
+    return 0;
+}
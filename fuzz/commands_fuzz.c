@@ -0,0 +1,137 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                     File: commands_fuzz.c                    *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Fuzz target for the commands the server sends. The input is run as a
+// batch of text commands with run_commands, then as a single binary
+// message, against a fresh game state each time. Afterwards the food
+// counted for each room is checked against the furniture.
+//
+// libFuzzer: commands_fuzz -close_fd_mask=1 corpus/
+// (close_fd_mask hides the "Invalid command" lines.)
+// AFL: afl-fuzz -i corpus -o findings -- ./commands_fuzz
+// Built with FUZZ_STANDALONE, the input is read from each file given, or
+// from stdin.
+
+// Includes
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "commands.h"
+#include "game.h"
+
+// Rooms the furniture is spread over. Small room numbers, so the fuzzer
+// finds them easily.
+#define FUZZ_ROOMS 25
+
+// Build the game state every input starts from. The house is as big as it
+// gets and every furniture slot exists, so item and room commands get past
+// validation, and most furniture has food in it, so picking items up
+// reaches emptyFurniture and the food counted for each room.
+static void seedState(GameState *state) {
+    memset(state, 0, sizeof(GameState));
+    state->houseW = HOUSE_MAX;
+    state->houseH = HOUSE_MAX;
+
+    // Same search areas as gamestate_new
+    state->furnitureAreas[0] = (Area){{150, 350}, 300};
+    state->furnitureAreas[1] = (Area){{530, 295}, 300};
+    state->furnitureAreas[2] = (Area){{1090, 75}, 200};
+    FurnitureTable *furniture = &state->furniture;
+    for (int i = 0; i < FURNITURE_MAX; i++) {
+        furniture->data[i] = (FurnitureData)(i % FURNITURE_COUNT + 1);
+        furniture->food[i] = (FoodData)(i % (FOOD_COUNT + 1));
+        furniture->room[i] = i % FUZZ_ROOMS;
+    }
+    furniture->count = FURNITURE_MAX;
+    indexFurniture(state);
+}
+
+// The food counted for each room has to match the furniture in it
+static void checkFurniture(const GameState *state) {
+    const FurnitureTable *furniture = &state->furniture;
+    for (int r = 0; r < furniture->roomCount; r++) {
+        int food = 0;
+        for (int k = furniture->roomStart[r]; k < furniture->roomStart[r + 1];
+             k++) {
+            food += furniture->food[furniture->roomFurniture[k]] != FOOD_NONE;
+        }
+        if (food != furniture->roomFood[r]) {
+            fprintf(stderr, "Room %d has %d food, counted %d\n",
+                    furniture->rooms[r], food, furniture->roomFood[r]);
+            abort();
+        }
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static GameState seeded;
+    static bool ready = false;
+    static GameState state;
+    static char text[65536];
+    if (size >= sizeof(text)) {
+        return 0;
+    }
+    if (!ready) {
+        seedState(&seeded);
+        ready = true;
+    }
+
+    // Text commands are null-terminated
+    memcpy(&state, &seeded, sizeof(GameState));
+    memcpy(text, data, size);
+    text[size] = '\0';
+    run_commands(text, &state);
+    checkFurniture(&state);
+
+    memcpy(&state, &seeded, sizeof(GameState));
+    ClientMessage message = {(char *)data, (int)size, PROTOCOL_BINARY};
+    run_message(&message, &state);
+    checkFurniture(&state);
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+
+// Read a whole file
+static uint8_t *readFile(FILE *file, size_t *size) {
+    size_t capacity = 4096;
+    uint8_t *data = (uint8_t *)malloc(capacity);
+    *size = 0;
+    size_t count;
+    while ((count = fread(data + *size, 1, capacity - *size, file)) > 0) {
+        *size += count;
+        if (*size == capacity) {
+            capacity *= 2;
+            data = (uint8_t *)realloc(data, capacity);
+        }
+    }
+    return data;
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc || i == 1; i++) {
+        FILE *file = i < argc ? fopen(argv[i], "rb") : stdin;
+        if (!file) {
+            perror(argv[i]);
+            return 1;
+        }
+
+        size_t size;
+        uint8_t *data = readFile(file, &size);
+        if (file != stdin) fclose(file);
+
+        LLVMFuzzerTestOneInput(data, size);
+        free(data);
+    }
+    return 0;
+}
+
+#endif
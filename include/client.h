@@ -1,26 +1,129 @@
 #pragma once
 
+#include "net.h"
+#include "netstats.h"
+#include "protocol.h"
+#include "ringbuffer.h"
 #include "tinycthread.h"
 #include <stdbool.h>
 
+// Longest message that can be returned when it wraps around the end of the
+// queue (including the null terminator). A game state is the longest.
+#define MESSAGE_MAX (BLOB_MAX + 2)
+
+// Size of the outgoing message buffer. Messages queued during a frame are
+// sent together when the buffer is flushed. It has room for a game state
+// on top of a frame's other messages.
+#define OUTBOX_SIZE (BLOB_MAX + 4096)
+
+// Largest datagram sent or recieved on the UDP channel
+#define DATAGRAM_MAX 512
+
+// Optional features asked for when joining a lobby
+#define FEATURE_UDP 1
+#define FEATURE_PREDICTION 2
+#define FEATURE_PING 4
+#define FEATURE_GAMESTATE 8
+
+// Bytes recieved from the network, written by the recieving thread and read
+// by the game thread without a lock. readOffset and readLimit belong to the
+// game thread: bytes handed out by clientNextMessage but not yet released,
+// and bytes available when iteration started.
+typedef struct {
+    RingBuffer ring;
+    size_t readOffset;
+    size_t readLimit;
+    // Game thread only: a message that wraps around the end of the queue is
+    // copied here so it can be returned as one piece. The bytes handed out
+    // before a release can only wrap once, so it's never needed twice, and
+    // each queue has its own so messages from both can be kept until then.
+    char wrapped[MESSAGE_MAX];
+} MessageQueue;
+
+// A single message from the server. data points straight into the client's
+// queue and is only valid until clientReleaseMessages is called.
+// Text messages are null-terminated. Binary messages start at the tag byte.
+typedef struct {
+    char *data;
+    int length;
+    int protocol;
+} ClientMessage;
+
 // Networkig client
 typedef struct Client {
     bool running;
-    int sockfd;
-    int qsize;
-    char *queue;
-    mtx_t mutex;
+    // True when a recieving thread fills the queue, false when the caller
+    // does it with clientPump.
+    bool threaded;
+    NetSocket sockfd;
+    // Stream recieved over TCP
+    MessageQueue queue;
+    // Binary frames recieved over UDP. Datagrams can't share the TCP queue,
+    // since they could land in the middle of a partially recieved message.
+    MessageQueue datagrams;
+    // Game thread only: messages waiting to be sent
+    int outboxSize;
+    char outbox[OUTBOX_SIZE];
+    // Protocol used for each direction. Both start as text, and change when
+    // the server answers the lobby join with its version.
+    int recvProtocol;
+    int sendProtocol;
+    // Features asked for when joining. FEATURE_UDP is cleared if the UDP
+    // socket couldn't be created.
+    int features;
+    // Features the server accepted. Old servers don't say, so this stays
+    // 0 and nothing optional is used.
+    int acceptedFeatures;
+    // UDP side channel for position and facing updates. Each datagram is
+    // |token (u32)|sequence (u32)|binary frames| when sent and
+    // |sequence (u32)|binary frames| when recieved. The token is handed out
+    // by the server when it accepts the channel.
+    NetSocket udpfd;
+    bool udpActive;
+    unsigned int udpToken;
+    unsigned int udpSendSequence;
+    // Recieving thread only: newest sequence seen for each command and
+    // player, so late datagrams don't overwrite newer state.
+    unsigned int udpRecvSequence[2][2];
+    // Written by the recieving thread: frames dropped because the datagram
+    // queue was full. The game thread copies it into stats.
+    atomic_ulong udpFramesDropped;
+    // Game thread only: frames waiting to be sent as one datagram
+    int udpOutboxSize;
+    char udpOutbox[DATAGRAM_MAX];
+    // Lobby joined, for commands the client sends by itself (pings)
+    int lobby;
+    // Game thread only: traffic counters and round trip time
+    NetStats stats;
     thrd_t recv_thread;
 } Client;
 
 // Send entire message
 int clientSendAll(Client *self, char *data, int length);
-// Recieve all messages
-char *clientRecvAll(Client *self);
+// Add a message to the outbox. It is sent on the next flush.
+int clientQueue(Client *self, const char *data, int length);
+// Encode a command into the outbox using the negotiated protocol. Position
+// and facing go over UDP when the side channel is active.
+int clientSendCommand(Client *self, int lobby, const Command *command);
+// Send every message in the outbox in one write, and the UDP outbox in one
+// datagram
+int clientFlush(Client *self);
+// Get the next complete message from the queue. Returns false when there are
+// no more messages.
+bool clientNextMessage(Client *self, ClientMessage *message);
+// Give all messages returned by clientNextMessage back to the queue
+void clientReleaseMessages(Client *self);
 // Connect to server
 int clientConnect(Client *self, char *hostname, int port);
-// Start client
+// Start client, with a thread that recieves from the network
 void clientStart(Client *self);
+// Start client without a recieving thread. Call clientPump when sockfd or
+// udpfd is readable (see NetPoller).
+void clientStartPolled(Client *self);
+// Read everything waiting on the sockets into the queues, without blocking.
+// Returns the number of bytes read, or -1 if the connection closed or
+// failed.
+int clientPump(Client *self);
 // Stop client
 void clientStop(Client *self);
 // Destroy client
@@ -2,7 +2,19 @@
 
 #include <stdlib.h>
 
+#include "client.h"
 #include "game.h"
+#include "protocol.h"
 
-// Run command from server
-int run_commands(char* command, GameState* state);
+// Apply a decoded command from server
+int applyCommand(const Command* command, GameState* state);
+// Run a single message recieved by the client, in either protocol
+int run_message(const ClientMessage* message, GameState* state);
+// Run every message waiting in the client's queue. Only the newest
+// position, facing, room and input ack of each player is decoded and
+// applied.
+int run_messages(Client* client, GameState* state);
+// Run a single text command from server
+int run_command(char* command, GameState* state);
+// Run commands from server, separated by \n, like run_messages
+int run_commands(char* commands, GameState* state);
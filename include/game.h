@@ -4,9 +4,11 @@
 #define SCREEN_W 1200
 #define SCREEN_H 800
 
-// House height and width
+// House height and width in rooms, when the room file doesn't give them
 #define HOUSE_H 2
 #define HOUSE_W 3
+// Largest house side. Room numbers are sent as 16 bits.
+#define HOUSE_MAX 255
 
 // Traps
 #define TRAP_COUNT 3
@@ -18,23 +20,24 @@
 #define FURNITURE_COUNT 3
 // Furniture slots
 #define FURNITURE_MAX 100
-// Largest possible room number
-#define ROOM_MAX HOUSE_H* HOUSE_W
 
-// Trap slots
-#define TRAP_MAX 100
+// Includes. The game logic doesn't use Allegro, so it builds without it
+// (see svs_core in CMakeLists.txt). Drawing is in graphics.h.
+#include <stdbool.h>
 
-// Constants for tracking keys.
-// Applied to keys array by using &=. This sets the OTHER bits to 0. The first
-// bit actually tracks the key press state, and the second one tracks key seen
-// state. To reset, set first two bits to one using KEY_SEEN | KEY_RELEASED.
-#define KEY_SEEN 1
-#define KEY_RELEASED 2
+#include "client.h"
+#include "input.h"
+#include "interpolation.h"
+#include "prediction.h"
+#include "traps.h"
 
-// Includes
-#include <allegro5/allegro.h>
+// The trap grid covers a room
+_Static_assert(TRAP_GRID_W * TRAP_CELL_SIZE >= SCREEN_W &&
+                   TRAP_GRID_H * TRAP_CELL_SIZE >= SCREEN_H,
+               "The trap grid doesn't cover a room");
 
-#include "client.h"
+// A replay being recorded or played back (see replay.h)
+struct Replay;
 
 // Trap, Food, and Furniture numbers. Used for networking, and when loading data
 typedef enum {
@@ -60,27 +63,12 @@ typedef enum {
     FURNITURE_BOOKSHELF = 3,
 } FurnitureData;
 
-// Furniture struct. Stores type, food, and room
-typedef struct {
-    FurnitureData data;
-    FoodData food;
-    int room;
-} Furniture;
-
 // Position struct, used everywhere
 typedef struct {
     float x;
     float y;
 } Position;
 
-// Trap struct. Stores Data, position, room, and owner
-typedef struct {
-    TrapData data;
-    Position pos;
-    int room;
-    int owner;
-} Trap;
-
 // Player struct. Stores data recieved from the server.
 typedef struct {
     Position pos;
@@ -89,6 +77,14 @@ typedef struct {
     bool roomChanged;
     float health;
     bool foodInventory[FOOD_COUNT];
+    // Where the player is drawn. For this player it's between the last two
+    // ticks. For the other player it trails pos, and is interpolated from
+    // the positions in snapshots.
+    Position renderPos;
+    // Position and room before the last tick
+    Position previousPos;
+    int previousRoom;
+    SnapshotBuffer snapshots;
 } Player;
 
 // Affected area for traps and furniture
@@ -97,6 +93,47 @@ typedef struct {
     float radius;
 } Area;
 
+// Furniture in the house, one array per field. The furniture from the room
+// file is in the first count slots, in the order it was listed, and the
+// slot is how it's named on the network.
+typedef struct {
+    int count;
+    FurnitureData data[FURNITURE_MAX];
+    FoodData food[FURNITURE_MAX];
+    int room[FURNITURE_MAX];
+    // Where each piece can be searched from
+    Area area[FURNITURE_MAX];
+    // Rooms with furniture in them, from lowest, and the slots of the
+    // furniture in each, in the order it's drawn. rooms[r] has
+    // roomFurniture[roomStart[r]] up to roomFurniture[roomStart[r + 1]].
+    // Empty rooms aren't listed, so big houses cost nothing extra. Built
+    // when the room file is loaded. Furniture with a bad room or type isn't
+    // in any room, and never has food.
+    int roomCount;
+    int rooms[FURNITURE_MAX];
+    int roomStart[FURNITURE_MAX + 1];
+    int roomFurniture[FURNITURE_MAX];
+    // Furniture in each of those rooms that still has food
+    int roomFood[FURNITURE_MAX];
+} FurnitureTable;
+
+// Send policy for the local player's position. A position is only sent
+// when it moved by more than epsilon (after rounding to what the wire
+// protocol can carry), or when heartbeat seconds have passed since the last
+// send.
+typedef struct {
+    float epsilon;
+    double heartbeat;
+    Position lastSent;
+    double sinceLastSend;
+    // True if the last send was a heartbeat
+    bool heartbeatSent;
+    // Counters: positions sent, and positions skipped because they hadn't
+    // changed
+    int sent;
+    int suppressed;
+} PositionPolicy;
+
 // GameState struct. Stores everything about the game, some of which should've
 // been stored on the server |:
 typedef struct {
@@ -104,44 +141,110 @@ typedef struct {
     int thisPlayer;
     int lobby;
     float startTime;
+    // Size of the house in rooms, from the room file. Rooms are numbered
+    // along each row, starting from the top left.
+    int houseW;
+    int houseH;
     int exitRoom;
     bool exitUnlocked;
     bool gameStarted;
     bool done;
-    Trap traps[TRAP_MAX];
+    TrapTable traps;
     Area furnitureAreas[FURNITURE_COUNT];
-    Furniture furniture[FURNITURE_MAX];
+    FurnitureTable furniture;
     bool trapInventory[TRAP_COUNT];
+    PositionPolicy positionPolicy;
+    // Inputs waiting for the server, when prediction is on
+    Prediction prediction;
+    // Set when the player was moved by something other than input, so the
+    // new position is sent to the server
+    bool teleported;
+    // Set when the server asked for the game state, for a player joining.
+    // It's sent at the end of the tick.
+    bool gameStateRequested;
+    // Seconds of game time, used to time stamp recieved positions
+    double clock;
+    // Ticks run so far
+    unsigned int tick;
+    // Length of a logic tick in seconds, and time waiting to be simulated.
+    // The logic always runs in whole ticks, whatever the frame rate.
+    double tickLength;
+    double accumulator;
+    // How far in the past the other player is drawn, and how long they keep
+    // moving after the newest position, in seconds
+    double interpolationDelay;
+    double maxExtrapolation;
+    // Network overlay, toggled with F3
+    bool showNetStats;
+    // Replay being recorded or played back, or NULL
+    struct Replay* replay;
 } GameState;
 
-// Assets struct. Only stores pointers
-typedef struct {
-    ALLEGRO_BITMAP* trapBitmaps[TRAP_COUNT];
-    ALLEGRO_BITMAP* foodBitmaps[FOOD_COUNT];
-    ALLEGRO_BITMAP* graySquirrelBitmaps[4];
-    ALLEGRO_BITMAP* brownSquirrelBitmaps[4];
-    ALLEGRO_BITMAP* slotIcon;
-    ALLEGRO_BITMAP* minimapIcon;
-    ALLEGRO_BITMAP* background;
-    ALLEGRO_BITMAP* grayIcon;
-    ALLEGRO_BITMAP* brownIcon;
-    ALLEGRO_BITMAP* foodInventoryIcon;
-    ALLEGRO_BITMAP* furnitureBitmaps[FURNITURE_COUNT];
-    ALLEGRO_BITMAP* arrowBitmaps[ARROW_COUNT];
-    ALLEGRO_BITMAP* healthBar;
-    ALLEGRO_BITMAP* exit;
-    ALLEGRO_BITMAP* helpScreens[3];
-    ALLEGRO_BITMAP* menu;
-} Assets;
+// Traps and furniture, one at a time. Loops over many of them read the
+// arrays they need directly, up to the count.
+static inline int trapCount(const GameState* state) {
+    return state->traps.count;
+}
+
+static inline TrapData trapData(const GameState* state, int trap) {
+    return (TrapData)state->traps.data[trap];
+}
+
+static inline Position trapPos(const GameState* state, int trap) {
+    return (Position){state->traps.x[trap], state->traps.y[trap]};
+}
+
+static inline int trapRoom(const GameState* state, int trap) {
+    return state->traps.room[trap];
+}
+
+static inline int trapOwner(const GameState* state, int trap) {
+    return state->traps.owner[trap];
+}
+
+static inline int trapId(const GameState* state, int trap) {
+    return state->traps.id[trap];
+}
+
+static inline int houseRooms(const GameState* state) {
+    return state->houseW * state->houseH;
+}
+
+static inline bool roomInHouse(const GameState* state, int room) {
+    return room >= 0 && room < houseRooms(state);
+}
+
+static inline int furnitureCount(const GameState* state) {
+    return state->furniture.count;
+}
+
+static inline FurnitureData furnitureData(const GameState* state,
+                                          int furniture) {
+    return state->furniture.data[furniture];
+}
+
+static inline FoodData furnitureFood(const GameState* state, int furniture) {
+    return state->furniture.food[furniture];
+}
+
+static inline int furnitureRoom(const GameState* state, int furniture) {
+    return state->furniture.room[furniture];
+}
 
 // Allocate and initialize GameState
 GameState* gamestate_new(int player, int room);
-// Run game logic. Runs every frame.
+// Set how many times a second the game logic runs
+void setTickRate(GameState* state, int ticksPerSecond);
+// Run the game logic ticks that fit in a frame
+void runFrame(Client* client, GameState* gameState, Player* player,
+              Player* other, MoveInput* input, double frameTime);
+// Run one tick of game logic
 void runGameLogic(Client* client, GameState* gameState, Player* player,
-                  Player* other, unsigned char key[ALLEGRO_KEY_MAX], double dt);
-// Logic for when the player presses a key.
-void onKeyDown(Client* client, GameState* gameState, ALLEGRO_EVENT event,
-               Player* player, Player* other);
+                  Player* other, int input, double dt);
+// Logic for when the player presses a key, after it was turned into an
+// action.
+void onAction(Client* client, GameState* gameState, Action action,
+              Player* player, Player* other);
 // Send a position update
 void updatePosition(Client* client, GameState* state);
 // Send a room update
@@ -152,6 +255,8 @@ void updateTrap(Client* client, GameState* state, TrapData trap);
 void updateLobby(Client* client, GameState* state);
 // Send trap activated to server
 void updateTrapActivated(Client* client, GameState* state, int trapN);
+// Send one tick of movement input, for prediction
+void updateInput(Client* client, GameState* state, int input, int duration);
 // Player is facing other direction
 void updateFacing(Client* client, GameState* state);
 // Take item from furniture
@@ -162,10 +267,36 @@ void updateItemTakenOnDeath(Client* client, GameState* state, int item);
 void updateAttack(Client* client, GameState* state, float damage);
 // Game over
 void updateGameOver(Client* client, GameState* state);
-// Load all assets
-void loadAssets(Assets* assets);
+// Send the game state, for a player joining
+void updateGameState(Client* client, GameState* state);
+
+// Decide whether a position update should be sent this frame
+bool shouldSendPosition(PositionPolicy* policy, Position pos, bool force,
+                        double dt);
+
+// Set where each player is drawn
+void interpolatePlayers(GameState* state);
+
+// Move a player for one tick of input
+void movePlayer(Player* player, int input, double dt);
+// Room on the other side of a door (from checkDoors), or -1 if it's an
+// outside wall
+int roomThroughDoor(const GameState* state, int room, int door);
+// Move a player through a door into the next room
+void walkThroughDoor(const GameState* state, Player* player, int door);
+// Apply the server's acknowledgement of an input, correcting the
+// prediction if needed
+void reconcilePrediction(GameState* state, const Command* command);
 
 // Check if player is making contact with any walls
 int checkDoors(Player* player);
-// Calculate distance between two points
-float euclidDistance(Position p1, Position p2);
\ No newline at end of file
+// Sort the furniture into rooms and work out its search areas. Called once
+// the room file is loaded.
+void indexFurniture(GameState* state);
+// Find a room in the furniture index. Returns where it is in rooms, or -1
+// if there's no furniture in it.
+int findFurnitureRoom(const FurnitureTable* furniture, int room);
+// Take the food out of a piece of furniture
+void emptyFurniture(GameState* state, int furniture);
+// Calculate the squared distance between two points
+float distanceSquared(Position p1, Position p2);
\ No newline at end of file
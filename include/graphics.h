@@ -1,7 +1,33 @@
 #pragma once
 
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_font.h>
+
 #include "game.h"
 
+// Assets struct. Only stores pointers
+typedef struct {
+    ALLEGRO_BITMAP* trapBitmaps[TRAP_COUNT];
+    ALLEGRO_BITMAP* foodBitmaps[FOOD_COUNT];
+    ALLEGRO_BITMAP* graySquirrelBitmaps[4];
+    ALLEGRO_BITMAP* brownSquirrelBitmaps[4];
+    ALLEGRO_BITMAP* slotIcon;
+    ALLEGRO_BITMAP* minimapIcon;
+    ALLEGRO_BITMAP* background;
+    ALLEGRO_BITMAP* grayIcon;
+    ALLEGRO_BITMAP* brownIcon;
+    ALLEGRO_BITMAP* foodInventoryIcon;
+    ALLEGRO_BITMAP* furnitureBitmaps[FURNITURE_COUNT];
+    ALLEGRO_BITMAP* arrowBitmaps[ARROW_COUNT];
+    ALLEGRO_BITMAP* healthBar;
+    ALLEGRO_BITMAP* exit;
+    ALLEGRO_BITMAP* helpScreens[3];
+    ALLEGRO_BITMAP* menu;
+    ALLEGRO_FONT* statsFont;
+} Assets;
+
+// Load all assets
+void loadAssets(Assets* assets);
 // Draw player images
 void drawPlayers(GameState* gameState, Player* player, Assets* assets);
 // Draw the room
@@ -19,4 +45,6 @@ void drawFoodInventory(GameState* gameState, Player* player, Assets* assets);
 // Draw traps on room
 void drawTraps(GameState* gameState, Player* player, Assets* assets);
 // Draw room arrows
-void drawArrows(GameState* gameState, Player* player, Assets* assets);
\ No newline at end of file
+void drawArrows(GameState* gameState, Player* player, Assets* assets);
+// Draw network statistics overlay
+void drawNetStats(Client* client, GameState* gameState, Assets* assets);
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+// Player input the game logic understands, without any keyboard or window
+// library. The game maps Allegro's keys to it, and anything without a
+// display (like a bot) can fill it in directly.
+// Movement directions are the INPUT_* bits from prediction.h.
+
+// Things a key press can do
+typedef enum {
+    ACTION_NONE = 0,
+    // Place a trap. The three are in TrapData order.
+    ACTION_TRAP_CHEESE = 1,
+    ACTION_TRAP_ACID = 2,
+    ACTION_TRAP_BOMB = 3,
+    // Search nearby furniture for food
+    ACTION_SEARCH = 4,
+    // Attack the other player
+    ACTION_ATTACK = 5,
+    // Show or hide the network overlay
+    ACTION_TOGGLE_STATS = 6,
+} Action;
+
+// Movement directions held. pressed keeps every direction pressed since
+// the last tick, so a key pressed and released between two ticks still
+// moves the player for one.
+typedef struct {
+    int held;
+    int pressed;
+} MoveInput;
+
+// Directions to move in this tick. Clears pressed.
+static inline int moveInputTake(MoveInput* input) {
+    int directions = input->held | input->pressed;
+    input->pressed = 0;
+    return directions;
+}
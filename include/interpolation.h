@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Snapshots kept per remote player
+#define SNAPSHOT_COUNT 32
+
+// A position recieved from the server, tagged with the server's clock
+typedef struct {
+    double time;
+    float x;
+    float y;
+} Snapshot;
+
+// Recent positions of a remote player, oldest to newest in a ring.
+// clockOffset estimates local time minus server time, so snapshots can be
+// placed on the local clock.
+typedef struct {
+    Snapshot snapshots[SNAPSHOT_COUNT];
+    int count;
+    int newest;
+    double clockOffset;
+} SnapshotBuffer;
+
+// Forget all snapshots, e.g. when the player changes rooms
+void snapshotClear(SnapshotBuffer* self);
+// Add a snapshot. serverTime is when the server sent it, localTime is when
+// it was recieved.
+void snapshotPush(SnapshotBuffer* self, double serverTime, double localTime,
+                  float x, float y);
+// Find the position at localTime - delay, interpolating between snapshots,
+// or extrapolating from the newest two for at most maxExtrapolation
+// seconds. Returns false if there are no snapshots.
+bool snapshotSample(const SnapshotBuffer* self, double localTime,
+                    double delay, double maxExtrapolation, float* x,
+                    float* y);
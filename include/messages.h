@@ -0,0 +1,115 @@
+#pragma once
+
+// Message schema. The fields of every message are listed once here, and
+// protocol.c expands these lists into the text and binary encoders and
+// decoders, including their bounds checks. Adding a message or a field only
+// means changing this file (and server.py).
+//
+// A field is F(kind, member, range): how it is carried, the Command member
+// that holds it, and the smallest and largest values it may have. Decoding
+// fails, and encoding refuses, when a value is out of range. Kinds:
+//   U8, U16, I16, U32  integers, with that width in the binary protocol
+//   INT                integer, only used by text messages
+//   POS                position, 1/32 pixels in binary
+//   DAMAGE             health points, 1/100 points in binary
+//   TIME               server time in milliseconds (u32). Optional, and only
+//                      as the last field.
+//   REASON             the rest of the message. Only as the last field.
+//   BLOB               the rest of the message, as bytes. Only as the last
+//                      field, and only in the binary protocol: a text
+//                      message can't carry one.
+//
+// In text every field is written as ",value" after the tag.
+
+// Field ranges
+#define ANY_U8 0, 255
+#define ANY_U16 0, 65535
+#define ANY_I16 -32768, 32767
+#define ANY_U32 0u, 4294967295u
+#define ANY_INT 0, 2147483647
+#define PLAYER_RANGE 0, 1
+#define FACING_RANGE 0, 3
+#define TRAP_DATA_RANGE 0, 3
+#define INPUT_RANGE 0, 15
+#define POSITION_RANGE 0.0f, 65535 / POSITION_SCALE
+#define DAMAGE_RANGE 0.0f, 65535 / DAMAGE_SCALE
+#define REASON_RANGE 1, REASON_MAX - 1
+#define BLOB_RANGE 1, BLOB_MAX
+
+// Fields of each message. _IN is sent by the server, _OUT by the client;
+// messages that are the same both ways have no suffix.
+#define POSITION_IN(F)                                        \
+    F(U8, player, PLAYER_RANGE) F(POS, x, POSITION_RANGE)     \
+    F(POS, y, POSITION_RANGE) F(TIME, time, ANY_U32)
+#define POSITION_OUT(F)                                       \
+    F(U8, player, PLAYER_RANGE) F(POS, x, POSITION_RANGE)     \
+    F(POS, y, POSITION_RANGE)
+#define ROOM_FIELDS(F) F(U8, player, PLAYER_RANGE) F(U16, room, ANY_U16)
+#define TRAP_OUT(F)                                                     \
+    F(U8, player, PLAYER_RANGE) F(U8, trapData, TRAP_DATA_RANGE)        \
+    F(U16, room, ANY_U16) F(POS, x, POSITION_RANGE)                     \
+    F(POS, y, POSITION_RANGE)
+#define TRAP_IN(F) TRAP_OUT(F) F(U16, trap, ANY_U16)
+#define KICK_IN(F) F(REASON, reason, REASON_RANGE)
+#define ITEM_FIELDS(F)                                        \
+    F(U8, player, PLAYER_RANGE) F(I16, furniture, ANY_I16)    \
+    F(U8, item, ANY_U8)
+#define ATTACK_IN(F) F(DAMAGE, damage, DAMAGE_RANGE)
+#define ATTACK_OUT(F) \
+    F(U8, player, PLAYER_RANGE) F(DAMAGE, damage, DAMAGE_RANGE)
+#define GAMEOVER_FIELDS(F) F(U8, player, PLAYER_RANGE)
+#define FACING_FIELDS(F) F(U8, player, PLAYER_RANGE) F(U8, facing, FACING_RANGE)
+#define TRAPACTIVATED_FIELDS(F) F(U16, trap, ANY_U16)
+#define INPUT_OUT(F)                                                 \
+    F(U8, player, PLAYER_RANGE) F(U32, sequence, ANY_U32)            \
+    F(U8, input, INPUT_RANGE) F(U8, duration, ANY_U8)
+#define INPUTACK_IN(F)                                                     \
+    F(U32, sequence, ANY_U32) F(POS, x, POSITION_RANGE)                    \
+    F(POS, y, POSITION_RANGE) F(U16, room, ANY_U16)
+#define PING_FIELDS(F) F(U32, sequence, ANY_U32)
+#define JOIN_OUT(F)                                                   \
+    F(INT, lobby, ANY_INT) F(U8, version, ANY_U8) F(U8, features, ANY_U8)
+#define VERSION_FIELDS(F) F(U8, version, ANY_U8)
+#define UDPTOKEN_IN(F) F(U32, token, ANY_U32)
+#define FEATURES_IN(F) F(U8, features, ANY_U8)
+#define GAMESTATE_FIELDS(F) F(BLOB, gameState, BLOB_RANGE)
+#define NO_FIELDS(F)
+
+// Messages sent by the server, in either protocol. X(tag, name, fields)
+#define SERVER_MESSAGES(X)                                    \
+    X(COMMAND_POSITION, Position, POSITION_IN)                \
+    X(COMMAND_ROOM, Room, ROOM_FIELDS)                        \
+    X(COMMAND_TRAP, Trap, TRAP_IN)                            \
+    X(COMMAND_KICK, Kick, KICK_IN)                            \
+    X(COMMAND_ITEM, Item, ITEM_FIELDS)                        \
+    X(COMMAND_ATTACK, Attack, ATTACK_IN)                      \
+    X(COMMAND_GAMEOVER, GameOver, GAMEOVER_FIELDS)            \
+    X(COMMAND_FACING, Facing, FACING_FIELDS)                  \
+    X(COMMAND_TRAPACTIVATED, TrapActivated, TRAPACTIVATED_FIELDS) \
+    X(COMMAND_INPUTACK, InputAck, INPUTACK_IN)                \
+    X(COMMAND_PONG, Pong, PING_FIELDS)                        \
+    X(COMMAND_GAMESTATEREQUEST, GameStateRequest, NO_FIELDS)  \
+    X(COMMAND_GAMESTATE, GameState, GAMESTATE_FIELDS)
+
+// Messages sent by the client, in either protocol. Text messages start with
+// the lobby number.
+#define CLIENT_MESSAGES(X)                                    \
+    X(COMMAND_POSITION, Position, POSITION_OUT)               \
+    X(COMMAND_ROOM, Room, ROOM_FIELDS)                        \
+    X(COMMAND_TRAP, Trap, TRAP_OUT)                           \
+    X(COMMAND_ITEM, Item, ITEM_FIELDS)                        \
+    X(COMMAND_ATTACK, Attack, ATTACK_OUT)                     \
+    X(COMMAND_GAMEOVER, GameOver, GAMEOVER_FIELDS)            \
+    X(COMMAND_FACING, Facing, FACING_FIELDS)                  \
+    X(COMMAND_TRAPACTIVATED, TrapActivated, TRAPACTIVATED_FIELDS) \
+    X(COMMAND_INPUT, Input, INPUT_OUT)                        \
+    X(COMMAND_PING, Ping, PING_FIELDS)                        \
+    X(COMMAND_GAMESTATE, GameState, GAMESTATE_FIELDS)
+
+// Negotiation messages, sent before the protocol is settled. Always text,
+// without a lobby number, in whichever direction they're used.
+#define NEGOTIATION_MESSAGES(X)               \
+    X(COMMAND_JOIN, Join, JOIN_OUT)           \
+    X(COMMAND_VERSION, Version, VERSION_FIELDS) \
+    X(COMMAND_UDPTOKEN, UdpToken, UDPTOKEN_IN) \
+    X(COMMAND_FEATURES, Features, FEATURES_IN)
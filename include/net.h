@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Platform socket handle. Winsock sockets are unsigned handles, POSIX
+// sockets are file descriptors.
+#ifdef _WIN32
+typedef uintptr_t NetSocket;
+#else
+typedef int NetSocket;
+#endif
+
+// Returned by socket() on failure on both platforms
+#define NET_INVALID_SOCKET ((NetSocket)-1)
+
+// Start networking. Exits on failure.
+void netStartup(void);
+// Close a socket
+void netClose(NetSocket sock);
+// Last socket error code
+int netLastError(void);
+// Check if the last socket call failed because it would have blocked
+bool netWouldBlock(void);
+// Make a socket non-blocking
+int netSetNonBlocking(NetSocket sock);
+// Wait until a socket can be read from. Returns 1 when readable, 0 on
+// timeout and -1 on error.
+int netWaitReadable(NetSocket sock, int timeoutMs);
+// Wait until any of count sockets can be read from. Same return values.
+int netWaitAnyReadable(const NetSocket *socks, int count, int timeoutMs);
+// Wait until a socket can be written to. Same return values.
+int netWaitWritable(NetSocket sock, int timeoutMs);
+// Sleep for a number of milliseconds
+void netSleep(int ms);
+// Seconds from a clock that only moves forward. Only differences between
+// two calls mean anything.
+double netTime(void);
+
+// Waits for any of many sockets to become readable. Used to drive many
+// clients from one thread.
+typedef struct NetPoller NetPoller;
+
+// Create a poller for up to capacity sockets
+NetPoller *netPollerNew(int capacity);
+// Watch a socket. userData is returned by netPollerWait when it's readable.
+int netPollerAdd(NetPoller *self, NetSocket sock, void *userData);
+// Stop watching a socket
+int netPollerRemove(NetPoller *self, NetSocket sock);
+// Wait for readable sockets. Fills ready with their userData and returns how
+// many there are, 0 on timeout or -1 on error.
+int netPollerWait(NetPoller *self, void **ready, int maxReady, int timeoutMs);
+// Free a poller
+void netPollerFree(NetPoller *self);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Commands are counted by their tag, which is always an ASCII letter
+#define STATS_TAGS 128
+
+// Messages and bytes for one command tag
+typedef struct {
+    unsigned long messages;
+    unsigned long bytes;
+} TrafficCount;
+
+// Counters for the networking path. Everything is updated by the game
+// thread, so the counters can be read while drawing without a lock.
+typedef struct {
+    // Per command tag. Bytes include framing ('\n' or the length header).
+    TrafficCount sent[STATS_TAGS];
+    TrafficCount recieved[STATS_TAGS];
+    // Time spent in clientSendAll, in seconds
+    unsigned long sendCalls;
+    double sendTime;
+    double sendTimeMax;
+    // Most bytes waiting in the recieve queue when the game drained it, and
+    // the size of the queue
+    size_t queueHighWater;
+    size_t queueCapacity;
+    // Frames recieved over UDP that didn't fit in the datagram queue
+    unsigned long datagramFramesDropped;
+    // Round trip time measured with ping and pong, in seconds. Zero until
+    // the first pong arrives.
+    unsigned int pingSequence;
+    double pingSentAt;
+    bool pingWaiting;
+    double rtt;
+    double rttSmoothed;
+} NetStats;
+
+// Count a message for a command tag
+void statsCount(TrafficCount* counts, int tag, int bytes);
+// Record how long a send took
+void statsSend(NetStats* self, double seconds);
+// Record a round trip time
+void statsRoundTrip(NetStats* self, double rtt);
+// Total messages and bytes over all tags
+TrafficCount statsTotal(const TrafficCount* counts);
+// Write the CSV column names
+void statsWriteHeader(FILE* file);
+// Write the current counters as a CSV row
+void statsWriteRow(const NetStats* self, FILE* file, double time);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Inputs kept until the server acknowledges them. At 60 ticks a second this
+// covers about two seconds of round trip.
+#define INPUT_HISTORY 128
+
+// Movement keys held during a tick
+#define INPUT_UP 1
+#define INPUT_LEFT 2
+#define INPUT_DOWN 4
+#define INPUT_RIGHT 8
+
+// One tick of input, and where it was predicted to leave the player
+typedef struct {
+    unsigned int sequence;
+    int input;
+    // Length of the tick in milliseconds. The server moves the player by
+    // exactly this much, so both sides get the same result.
+    int duration;
+    float x;
+    float y;
+    int room;
+} InputTick;
+
+// Inputs sent to the server but not yet acknowledged, oldest first
+typedef struct {
+    InputTick pending[INPUT_HISTORY];
+    int first;
+    int count;
+    // Sequence of the last input sent
+    unsigned int sequence;
+    // Acknowledgements up to this sequence are ignored: either already
+    // applied, or sent before the player was teleported.
+    unsigned int acknowledged;
+    // Acknowledgements that didn't match the prediction
+    int corrections;
+} Prediction;
+
+// Record an input. Returns it so the predicted result can be filled in.
+InputTick* predictionRecord(Prediction* self, int input, int duration);
+// Drop inputs the server has applied, up to sequence. Returns 1 and copies
+// the input with that sequence to acknowledged if it's still kept, 0 if it
+// isn't, or -1 if the acknowledgement is stale and should be ignored.
+int predictionAcknowledge(Prediction* self, unsigned int sequence,
+                          InputTick* acknowledged);
+// Forget pending inputs after the player was moved by something other than
+// input. Acknowledgements for inputs sent before now are ignored.
+void predictionTeleport(Prediction* self);
+// Get the i-th unacknowledged input, oldest first
+InputTick* predictionPending(Prediction* self, int i);
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Protocol versions. Every connection starts with the text protocol, and
+// switches to binary after the lobby join if both sides support it.
+#define PROTOCOL_TEXT 0
+#define PROTOCOL_BINARY 1
+// Newest protocol this client understands
+#define PROTOCOL_VERSION PROTOCOL_BINARY
+
+// Binary frames start with a little-endian 16 bit length, which counts the
+// tag byte and the payload after it.
+#define FRAME_HEADER_SIZE 2
+
+// Fixed point scales used by the binary protocol
+#define POSITION_SCALE 32.0f
+#define DAMAGE_SCALE 100.0f
+
+// Longest kick reason
+#define REASON_MAX 101
+
+// Longest blob of bytes in a message (a game state, see serialize.h)
+#define BLOB_MAX 16384
+
+// Command tags. These are the same in both protocols.
+typedef enum {
+    COMMAND_POSITION = 'P',
+    COMMAND_ROOM = 'R',
+    COMMAND_TRAP = 'T',
+    COMMAND_KICK = 'K',
+    COMMAND_ITEM = 'I',
+    COMMAND_ATTACK = 'C',
+    COMMAND_GAMEOVER = 'O',
+    COMMAND_FACING = 'F',
+    COMMAND_TRAPACTIVATED = 'A',
+    COMMAND_INPUT = 'M',
+    COMMAND_INPUTACK = 'Q',
+    COMMAND_PING = 'G',
+    COMMAND_PONG = 'H',
+    COMMAND_GAMESTATEREQUEST = 'W',
+    COMMAND_GAMESTATE = 'Z',
+    COMMAND_JOIN = 'J',
+    COMMAND_VERSION = 'V',
+    COMMAND_UDPTOKEN = 'U',
+    COMMAND_FEATURES = 'E',
+} CommandType;
+
+// Bytes carried by a message. When decoded, data points into the message.
+typedef struct {
+    const char *data;
+    int length;
+} Blob;
+
+// A decoded command. Only the fields used by the command's type are set.
+typedef struct {
+    CommandType type;
+    // P, R, T (owner), I, F, O (winner), C (target, outgoing only), M
+    int player;
+    // R, T, Q
+    int room;
+    // P, T, Q
+    float x;
+    float y;
+    // P. Server time in seconds when it was sent, or -1 if not given.
+    double time;
+    // T
+    int trapData;
+    // A, T (incoming only). ID the server gave the trap.
+    int trap;
+    // F
+    int facing;
+    // I. furniture is -1 when the item is taken from a player.
+    int furniture;
+    int item;
+    // C
+    float damage;
+    // M, Q, G, H
+    unsigned int sequence;
+    // M. Movement keys held (see INPUT_* in prediction.h), and the length of
+    // the tick in milliseconds.
+    int input;
+    int duration;
+    // J
+    int lobby;
+    // J, V
+    int version;
+    // J: optional features asked for (see FEATURE_* in client.h). E:
+    // features the server accepted.
+    int features;
+    // U
+    unsigned int token;
+    // K
+    char reason[REASON_MAX];
+    // Z. A serialized game state.
+    Blob gameState;
+} Command;
+
+// Decode a command sent by the server. For the text protocol data is one
+// line without its '\n'. For the binary protocol data starts at the tag
+// byte.
+bool decodeCommand(const char *data, int length, int protocol,
+                   Command *command);
+// Encode a command to send to the server. Returns the number of bytes
+// written, -1 if it doesn't fit in size bytes, or -2 if it can't be encoded
+// at all (a value is out of range, or the command can't be sent).
+int encodeCommand(const Command *command, int protocol, int lobby, char *out,
+                  int size);
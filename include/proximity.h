@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+// Words of hit bits needed for count points
+#define PROXIMITY_WORDS(count) (((count) + 31) / 32)
+
+// Check a batch of points, given as separate x and y arrays, against a
+// circle around (x, y). Bit i % 32 of hits[i / 32] is set if point i is
+// within radius (inclusive). hits needs PROXIMITY_WORDS(count) words.
+// Returns the number of points within radius.
+int proximityQuery(const float* xs, const float* ys, int count, float x,
+                   float y, float radius, uint32_t* hits);
+// Same as proximityQuery, with a radius for each point
+int proximityQueryEach(const float* xs, const float* ys, const float* radii,
+                       int count, float x, float y, uint32_t* hits);
+
+// Check if bit i is set in hits
+static inline int proximityHit(const uint32_t* hits, int i) {
+    return (hits[i / 32] >> (i % 32)) & 1;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+// Replays: a journal of everything that reaches the game logic (tick
+// inputs, key actions and the messages from the server), which can be run
+// again later, without a network, as fast as the CPU allows.
+//
+// The journal is a header followed by records, each starting with a tag
+// byte. Numbers marked varint are 7 bits a byte, low bits first, with the
+// top bit set on every byte but the last.
+//   header |"SVSR"|version (u8)|player (u8)|lobby (varint)|tick ms (u8)|
+//   'K' a tick ran                 |input (u8)|
+//   'A' a key was pressed          |action (u8)|
+//   'M' a message from the server  |protocol (u8)|length (varint)|bytes|0|
+//   'F' the client's flags changed |features (u7) + udpActive << 7 (u8)|
+//   'D' digest of the game state   |tick (varint)|digest (u32)|
+// Messages are recorded in the tick that ran them, so they come after the
+// 'K' record. A digest is recorded at the start and every REPLAY_DIGEST_TICKS
+// ticks, and playback checks it to find where a replay went differently.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "client.h"
+#include "game.h"
+
+#define REPLAY_VERSION 1
+// Ticks between digests (one a second)
+#define REPLAY_DIGEST_TICKS 60
+
+// A replay being recorded or played back
+typedef struct Replay {
+    bool playing;
+    int player;
+    int lobby;
+    int tickMilliseconds;
+    // Recording: the journal, and the client flags last written
+    FILE* file;
+    int flags;
+    // Playback: the whole journal, and how far it's been read
+    unsigned char* data;
+    size_t size;
+    size_t offset;
+    // Playback: digests checked, and how many didn't match
+    int digests;
+    int desyncs;
+} Replay;
+
+// Start recording to a file, from the state the game is in now. Returns
+// NULL if the file can't be created.
+Replay* replayRecord(const char* path, const GameState* state);
+// Load a journal to play back. Returns NULL if it can't be read or isn't a
+// replay.
+Replay* replayLoad(const char* path);
+// Finish recording (or playing) and free the replay
+void replayClose(Replay* self);
+
+// Recording hooks, called by the game logic when state->replay is set
+// Called at the start of every tick, with its input
+void replayRecordTick(Replay* self, const Client* client, int input);
+// Called for every action. Actions that do nothing aren't recorded.
+void replayRecordAction(Replay* self, Action action);
+// Called for every message run
+void replayRecordMessage(Replay* self, const ClientMessage* message);
+// Called once the client has no messages left this tick
+void replayRecordClient(Replay* self, const Client* client);
+// Called at the end of every tick
+void replayRecordDigest(Replay* self, const GameState* state);
+
+// Playback: the next message recorded in this tick. Flag changes recorded
+// between messages are applied to client. Returns false when the tick has
+// no more. The message points into the journal and stays valid until the
+// replay is closed.
+bool replayNextMessage(Replay* self, Client* client, ClientMessage* message);
+// Play the whole journal on a new game state made with the replay's player
+// and lobby. client isn't connected to anything, so everything sent is
+// dropped. Returns the number of digests that didn't match, or -1 if the
+// journal is damaged.
+int replayPlay(Replay* self, Client* client, GameState* state);
+
+// Hash of the game state that playback has to reproduce: the players,
+// traps, food and inventory
+unsigned int replayDigest(const GameState* state);
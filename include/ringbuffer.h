@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Size of a cache line. Used to keep the producer and consumer indices on
+// separate cache lines so the two threads don't fight over the same line.
+#define CACHE_LINE_SIZE 64
+
+// Single-producer, single-consumer byte ring buffer.
+// head and tail are free-running counters; the index into data is found by
+// masking with (capacity - 1), so capacity must be a power of two.
+// Only the producer writes head, and only the consumer writes tail.
+typedef struct {
+    // Producer side
+    atomic_size_t head;
+    char headPadding[CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+    // Consumer side
+    atomic_size_t tail;
+    char tailPadding[CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+    // Shared, read-only after init
+    char *data;
+    size_t capacity;
+    size_t mask;
+} RingBuffer;
+
+// Allocate ring buffer storage. Capacity must be a power of two.
+bool ringInit(RingBuffer *self, size_t capacity);
+// Free ring buffer storage
+void ringFree(RingBuffer *self);
+
+// Producer: get a pointer to contiguous free space, and how much of it there
+// is. Returns 0 in *space when the buffer is full.
+char *ringWritePtr(RingBuffer *self, size_t *space);
+// Producer: publish length bytes written through ringWritePtr
+void ringCommitWrite(RingBuffer *self, size_t length);
+// Producer: copy length bytes in and publish them, wrapping around if
+// needed. Returns false without writing anything if they don't fit.
+bool ringWrite(RingBuffer *self, const char *data, size_t length);
+
+// Consumer: number of bytes waiting to be read
+size_t ringReadable(RingBuffer *self);
+// Consumer: get a pointer to the byte offset bytes after tail, and how many
+// bytes follow it before the storage wraps around.
+char *ringReadPtr(RingBuffer *self, size_t offset, size_t *contiguous);
+// Consumer: copy length bytes starting offset bytes after tail into dst
+void ringCopyOut(RingBuffer *self, size_t offset, char *dst, size_t length);
+// Consumer: release length bytes back to the producer
+void ringConsume(RingBuffer *self, size_t length);
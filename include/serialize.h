@@ -0,0 +1,39 @@
+#pragma once
+
+// The game state as bytes, so a player joining a game that already started
+// (or coming back after dropping) can pick up where it is. The other client
+// writes it, and the server passes it on in one message (see protocol.c).
+//
+// Only what both clients share is written: the players, the traps, the food
+// left in the furniture, and whether the exit is unlocked. Everything is
+// little-endian:
+//   |version (u8)|exit unlocked (u8)|
+//   2 players:   |x (f32)|y (f32)|room (u16)|facing (u8)|food (u8 bits)|
+//   |furniture count (u8)|food (u8) for each|
+//   |trap count (u16)|
+//   each trap:   |id (u16)|owner (u8)|data (u8)|room (u16)|x (f32)|y (f32)|
+// Furniture is named by slot, so both clients need the same room file.
+
+#include "game.h"
+
+#define GAMESTATE_VERSION 1
+
+// Bytes in each part
+#define GAMESTATE_HEADER_SIZE 2
+#define GAMESTATE_PLAYER_SIZE 12
+#define GAMESTATE_TRAP_SIZE 14
+// Longest game state
+#define GAMESTATE_MAX                                                   \
+    (GAMESTATE_HEADER_SIZE + 2 * GAMESTATE_PLAYER_SIZE + 1 +            \
+     FURNITURE_MAX + 2 + TRAP_MAX * GAMESTATE_TRAP_SIZE)
+
+// It's sent in one message
+_Static_assert(GAMESTATE_MAX <= BLOB_MAX, "A game state doesn't fit BLOB_MAX");
+
+// Write the game state to out, which has room for size bytes. Returns the
+// number of bytes written, or -1 if it doesn't fit.
+int serializeGameState(const GameState* state, char* out, int size);
+// Replace the shared parts of the game state with a written one. Nothing is
+// changed if it's from another version, doesn't match the room file, or is
+// damaged. Returns false then.
+bool deserializeGameState(GameState* state, const char* data, int length);
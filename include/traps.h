@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Trap slots
+#define TRAP_MAX 1024
+// Entries in the ID lookup. A power of two, more than twice TRAP_MAX so
+// probes stay short.
+#define TRAP_LOOKUP_SIZE 2048
+
+// Grid the traps in each room are sorted into. It has to cover a room of
+// SCREEN_W by SCREEN_H pixels (checked in game.h). Cells are bigger than
+// the trap radius, so a query only looks at a few of them.
+#define TRAP_CELL_SIZE 100
+#define TRAP_GRID_W 12
+#define TRAP_GRID_H 8
+#define TRAP_GRID_CELLS (TRAP_GRID_W * TRAP_GRID_H)
+
+// Lists the rooms and cells are hashed into. Powers of two. Houses can have
+// thousands of rooms, but only TRAP_MAX traps, so rooms and cells share
+// lists instead of each having one. The size of the grid, and the time a
+// query takes, don't depend on the size of the house.
+#define TRAP_ROOM_LISTS 256
+#define TRAP_CELL_LISTS 4096
+
+// Placed traps by room, and by cell within the room, so only the traps near
+// a position have to be checked. The lists are linked through the trap
+// slots, and are kept up to date by the trap table. A list can also hold
+// traps from other rooms or cells that hash to it, which are skipped.
+// Links are one more than the slot, so 0 ends a list, and all zeroes is an
+// empty grid.
+typedef struct {
+    int roomFirst[TRAP_ROOM_LISTS];
+    int cellFirst[TRAP_CELL_LISTS];
+    // Next and previous trap in the same room, and in the same cell
+    int roomNext[TRAP_MAX];
+    int roomPrev[TRAP_MAX];
+    int cellNext[TRAP_MAX];
+    int cellPrev[TRAP_MAX];
+    // Cell each slot is in, counting across all rooms
+    int cell[TRAP_MAX];
+} TrapGrid;
+
+// First trap in a room, or -1 if there are none
+int trapGridRoomFirst(const TrapGrid* self, int room);
+// Next trap in the same room, or -1 after the last
+int trapGridRoomNext(const TrapGrid* self, int slot);
+// Find the traps in cells within radius of a position. Their slots are
+// written to slots, up to max of them. Returns how many were written. The
+// caller still has to check the distance.
+int trapGridQuery(const TrapGrid* self, int room, float x, float y,
+                  float radius, int* slots, int max);
+
+// Open addressing table from the ID the server gave a trap to its slot.
+// slot is one more than the trap's slot, or 0 for an empty entry.
+typedef struct {
+    int id[TRAP_LOOKUP_SIZE];
+    int slot[TRAP_LOOKUP_SIZE];
+} TrapLookup;
+
+// Placed traps, one array per field. Live traps are packed into the first
+// count slots, so scans stop at count and only read the fields they need.
+// When a trap is removed, the last trap moves into its slot.
+// The server gives every trap an ID when it's placed, and both clients use
+// it to name the trap, whatever slot it's in.
+// All zeroes is an empty table.
+typedef struct {
+    int count;
+    float x[TRAP_MAX];
+    float y[TRAP_MAX];
+    int room[TRAP_MAX];
+    // TrapData, and which player placed it
+    int data[TRAP_MAX];
+    int owner[TRAP_MAX];
+    int id[TRAP_MAX];
+    TrapLookup lookup;
+    TrapGrid grid;
+} TrapTable;
+
+// Add a trap. Returns its slot, or -1 if every slot is used or the ID is
+// already placed.
+int trapTableAdd(TrapTable* self, int id, int data, int owner, int room,
+                 float x, float y);
+// Find the slot of a trap ID. Returns -1 if there's no trap with it.
+int trapTableFind(const TrapTable* self, int id);
+// Remove the trap in a slot. The last trap moves into the slot.
+void trapTableRemove(TrapTable* self, int slot);
@@ -0,0 +1,111 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                        File: playback.c                      *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Plays replays back without a display or a network, as fast as the CPU
+// allows. The game and the bot record one when started with -r file. Each
+// replay checks the game state against the digests recorded with it, so a
+// set of replays works as a regression test, and playing one many times is
+// a workload for profiling the game logic.
+//
+// Usage: playback [-n runs] replay...
+//   -n runs   times to play each replay. The fastest run is reported.
+// Run from bin/, since the level is read from room.txt. Exits with 1 if
+// any replay went differently or couldn't be played.
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "client.h"
+#include "game.h"
+#include "replay.h"
+
+// Seconds from a clock for timing
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Play a replay once, from a new game state. Returns the desyncs, or -1.
+// ticks and played are how much of the game was played, in ticks and
+// seconds of game time.
+static int playOnce(const char *path, unsigned int *ticks, double *played,
+                    double *elapsed) {
+    *ticks = 0;
+    *played = 0.0;
+    *elapsed = 0.0;
+    Replay *replay = replayLoad(path);
+    if (!replay) {
+        return -1;
+    }
+    GameState *state = gamestate_new(replay->player, replay->lobby);
+    if (!state) {
+        replayClose(replay);
+        return -1;
+    }
+    // Never connected, so everything the game sends is dropped
+    Client *client = clientInit();
+
+    double start = now();
+    int result = replayPlay(replay, client, state);
+    *elapsed = now() - start;
+    *ticks = state->tick;
+    *played = state->clock;
+    if (result >= 0 && replay->digests == 0) {
+        printf("%s: no digests to check\n", path);
+    }
+
+    clientFree(client);
+    free(state);
+    replayClose(replay);
+    return result;
+}
+
+static int usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-n runs] replay...\n", program);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    int runs = 1;
+    int first = 1;
+    if (argc > 2 && argv[1][0] == '-' && argv[1][1] == 'n') {
+        runs = atoi(argv[2]);
+        first = 3;
+    }
+    if (runs <= 0 || first >= argc) {
+        return usage(argv[0]);
+    }
+
+    int failed = 0;
+    for (int i = first; i < argc; i++) {
+        double best = 1e9;
+        unsigned int ticks = 0;
+        double played = 0.0;
+        int result = 0;
+        for (int run = 0; run < runs && result == 0; run++) {
+            double elapsed;
+            result = playOnce(argv[i], &ticks, &played, &elapsed);
+            if (elapsed < best) best = elapsed;
+        }
+
+        if (result != 0) {
+            printf("%s: FAILED after %u ticks\n", argv[i], ticks);
+            failed = 1;
+            continue;
+        }
+        printf("%s: %u ticks (%.1f s of play) in %.3f ms, %.0f ticks a "
+               "second, %.2f us a tick\n",
+               argv[i], ticks, played, best * 1000.0, ticks / best,
+               best * 1e6 / (ticks ? ticks : 1));
+    }
+    return failed;
+}
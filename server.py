@@ -1,5 +1,9 @@
 from socketserver import BaseRequestHandler, TCPServer, ThreadingMixIn
+import secrets
+import socket
+import struct
 import threading
+import time
 from queue import Queue
 from queue import Empty as QueueEmpty
 
@@ -14,17 +18,204 @@ FACING = "F"
 TRAPACTIVATED = "A"
 ITEMTAKEN = "I"
 ATTACK = "C"
+INPUT = "M"
+INPUTACK = "Q"
+PING = "G"
+PONG = "H"
+GAMESTATEREQUEST = "W"
+GAMESTATE = "Z"
 
 # Lobby commands
 JOINLOBBY = "J"
-
-ROOM_N = 6
+VERSION = "V"
+UDPTOKEN = "U"
+FEATURES = "E"
+
+# Trap IDs fit in a u16 in the binary protocol
+TRAP_ID_COUNT = 65536
+
+# Movement, for clients using prediction. These mirror movePlayer and
+# walkThroughDoor in game.c, including rounding to 32 bit floats after each
+# step, so the server ends up exactly where the client predicted.
+SCREEN_W = 1200
+SCREEN_H = 800
+SPEED = 600
+INPUT_UP = 1
+INPUT_LEFT = 2
+INPUT_DOWN = 4
+INPUT_RIGHT = 8
+FLOAT = struct.Struct("<f")
+
+
+def read_house(path="room.txt"):
+    """House width and height in rooms, from the H line of the room file the
+    clients load. Same defaults and limits as gamestate_new in game.c."""
+    width, height = 3, 2
+    try:
+        with open(path) as f:
+            for line in f:
+                parts = line.split()
+                if (len(parts) >= 3 and parts[0] == "H" and
+                        parts[1].isdigit() and parts[2].isdigit()):
+                    w, h = int(parts[1]), int(parts[2])
+                    if 0 < w <= 255 and 0 < h <= 255:
+                        width, height = w, h
+    except OSError:
+        pass
+    return width, height
+
+
+HOUSE_W, HOUSE_H = read_house()
+ROOM_N = HOUSE_W * HOUSE_H
+
+
+def f32(value):
+    return FLOAT.unpack(FLOAT.pack(value))[0]
+
+
+def move_player(x, y, room, keys, dt):
+    step = SPEED * dt
+    if keys & INPUT_UP:
+        y = f32(y - min(step, y))
+    if keys & INPUT_LEFT:
+        x = f32(x - min(step, x))
+    if keys & INPUT_DOWN:
+        y = f32(y + min(step, SCREEN_H - y))
+    if keys & INPUT_RIGHT:
+        x = f32(x + min(step, SCREEN_W - x))
+
+    # Doors
+    if x == 0:
+        if room % HOUSE_W != 0:
+            room -= 1
+            x = SCREEN_W - 5
+    elif x == SCREEN_W:
+        if room % HOUSE_W != HOUSE_W - 1:
+            room += 1
+            x = 5
+    elif y == 0:
+        if room - HOUSE_W >= 0:
+            room -= HOUSE_W
+            y = SCREEN_H - 5
+    elif y == SCREEN_H:
+        if room + HOUSE_W < ROOM_N:
+            room += HOUSE_W
+            y = 5
+    return x, y, room
+
+# Protocol versions. Connections start as text, and switch to binary after
+# the lobby join. Each side sends a V line right before it switches.
+PROTOCOL_TEXT = 0
+PROTOCOL_BINARY = 1
+PROTOCOL_VERSION = PROTOCOL_BINARY
+
+# Binary frames: |length (u16)|tag (u8)|payload|, little-endian. Positions
+# are in 1/32 pixels and damage in 1/100 points.
+FRAME_HEADER = struct.Struct("<H")
+
+# UDP side channel for position and facing. Datagrams from clients start
+# with |token (u32)|sequence (u32)|, datagrams to clients with
+# |sequence (u32)|, followed by binary frames.
+FEATURE_UDP = 1
+FEATURE_PREDICTION = 2
+FEATURE_PING = 4
+FEATURE_GAMESTATE = 8
+UDP_COMMANDS = (POSITION, FACING)
+DATAGRAM_MAX = 512
+CLIENT_DATAGRAM_HEADER = struct.Struct("<II")
+SERVER_DATAGRAM_HEADER = struct.Struct("<I")
+POSITION_SCALE = 32
+DAMAGE_SCALE = 100
+
+# Relayed positions are stamped with the server clock, in milliseconds, so
+# clients can interpolate the other player.
+SERVER_START = time.monotonic()
+
+
+def server_time():
+    return str(int((time.monotonic() - SERVER_START) * 1000) & 0xFFFFFFFF)
+
+
+def to_fixed(value, scale):
+    return max(0, min(0xFFFF, round(float(value) * scale)))
+
+
+def from_fixed(value, scale):
+    return str(value / scale)
+
+
+# Payloads sent by clients: struct format, and how to turn each field back
+# into the string the text protocol would have carried.
+BINARY_RECV = {
+    POSITION: ("<BHH", (str, lambda v: from_fixed(v, POSITION_SCALE),
+                        lambda v: from_fixed(v, POSITION_SCALE))),
+    ROOM: ("<BH", (str, str)),
+    TRAP: ("<BBHHH", (str, str, str, lambda v: from_fixed(v, POSITION_SCALE),
+                      lambda v: from_fixed(v, POSITION_SCALE))),
+    ATTACK: ("<BH", (str, lambda v: from_fixed(v, DAMAGE_SCALE))),
+    GAMEOVER: ("<B", (str,)),
+    ITEMTAKEN: ("<BhB", (str, str, str)),
+    TRAPACTIVATED: ("<H", (str,)),
+    FACING: ("<BB", (str, str)),
+    INPUT: ("<BIBB", (str, str, str, str)),
+    PING: ("<I", (str,)),
+}
+
+# Payloads sent to clients: struct format, and how to turn each text field
+# into the packed value.
+BINARY_SEND = {
+    POSITION: ("<BHHI", (int, lambda v: to_fixed(v, POSITION_SCALE),
+                         lambda v: to_fixed(v, POSITION_SCALE), int)),
+    ROOM: ("<BH", (int, int)),
+    TRAP: ("<BBHHHH", (int, int, int, lambda v: to_fixed(v, POSITION_SCALE),
+                       lambda v: to_fixed(v, POSITION_SCALE), int)),
+    ITEMTAKEN: ("<BhB", (int, int, int)),
+    ATTACK: ("<H", (lambda v: to_fixed(v, DAMAGE_SCALE),)),
+    GAMEOVER: ("<B", (int,)),
+    FACING: ("<BB", (int, int)),
+    TRAPACTIVATED: ("<H", (int,)),
+    INPUTACK: ("<IHHH", (int, lambda v: to_fixed(v, POSITION_SCALE),
+                         lambda v: to_fixed(v, POSITION_SCALE), int)),
+    PONG: ("<I", (int,)),
+    GAMESTATEREQUEST: ("<", ()),
+}
+
+
+def encode_binary(args):
+    tag = args[0]
+    if tag == KICK:
+        payload = ",".join(args[1:]).encode("utf-8")
+    elif tag == GAMESTATE:
+        # Passed on as it came
+        payload = args[1]
+    else:
+        fmt, converters = BINARY_SEND[tag]
+        values = [convert(arg) for convert, arg in zip(converters, args[1:])]
+        payload = struct.pack(fmt, *values)
+
+    body = tag.encode("utf-8") + payload
+    return FRAME_HEADER.pack(len(body)) + body
+
+
+def decode_binary(lobbyN, body):
+    tag = chr(body[0])
+    if tag == GAMESTATE:
+        return [str(lobbyN), tag, body[1:]]
+    fmt, converters = BINARY_RECV[tag]
+    values = struct.unpack(fmt, body[1:])
+    fields = [convert(value) for convert, value in zip(converters, values)]
+    return [str(lobbyN), tag] + fields
 
 
 class Client(BaseRequestHandler):
     def setup(self):
         self.running = True
         self.outqueue = Queue()
+        self.recv_protocol = PROTOCOL_TEXT
+        self.send_protocol = PROTOCOL_TEXT
+        self.udp_addr = None
+        self.udp_send_seq = 0
+        self.udp_recv_seq = {}
         self.ip, self.port = "Unknown address", "Unknown port"
         self.start()
 
@@ -75,16 +266,84 @@ class Client(BaseRequestHandler):
 
             buffer.extend(data)
 
-            while b"\n" in buffer:
-                args, buffer = buffer.split(b"\n", 1)
-                args = args.decode("utf-8").strip("\x00").split(",")
+            while True:
+                if self.recv_protocol == PROTOCOL_BINARY:
+                    if len(buffer) < FRAME_HEADER.size:
+                        break
+                    (length,) = FRAME_HEADER.unpack_from(buffer)
+                    if len(buffer) < FRAME_HEADER.size + length:
+                        break
+
+                    body = bytes(buffer[FRAME_HEADER.size:FRAME_HEADER.size + length])
+                    buffer = buffer[FRAME_HEADER.size + length:]
+                    try:
+                        args = decode_binary(self.lobby.lobbyN, body)
+                    except (KeyError, IndexError, struct.error, AttributeError):
+                        print(f"Invalid binary message: {body!r}")
+                        continue
+                else:
+                    if b"\n" not in buffer:
+                        break
+                    args, buffer = buffer.split(b"\n", 1)
+                    args = args.decode("utf-8").strip("\x00").split(",")
+
+                    # The client switches protocol right after this line
+                    if args[0] == VERSION:
+                        try:
+                            self.recv_protocol = int(args[1])
+                        except (IndexError, ValueError):
+                            print(f"Invalid version: {args}")
+                        continue
 
                 model.enqueue(model.on_data, self, (args,))
 
         model.enqueue(model.on_disconnect, self)
 
     def send(self, *args):
-        self.outqueue.put((",".join(args) + "\n").encode("utf-8"))
+        if self.udp_addr is not None and args[0] in UDP_COMMANDS:
+            self.send_datagram(encode_binary(args))
+        elif self.send_protocol == PROTOCOL_BINARY and args[0] not in (VERSION, UDPTOKEN, FEATURES):
+            self.outqueue.put(encode_binary(args))
+        else:
+            self.outqueue.put((",".join(args) + "\n").encode("utf-8"))
+
+    def send_datagram(self, frame):
+        self.udp_send_seq += 1
+        datagram = SERVER_DATAGRAM_HEADER.pack(self.udp_send_seq) + frame
+        try:
+            self.server.model.udp_socket.sendto(datagram, self.udp_addr)
+        except OSError as e:
+            print("Error sending datagram:", repr(e))
+
+    def on_datagram(self, addr, seq, frames):
+        # Replies go to wherever the latest datagram came from
+        self.udp_addr = addr
+
+        offset = 0
+        while offset + FRAME_HEADER.size < len(frames):
+            (length,) = FRAME_HEADER.unpack_from(frames, offset)
+            body = frames[offset + FRAME_HEADER.size:offset + FRAME_HEADER.size + length]
+            offset += FRAME_HEADER.size + length
+            if len(body) != length or length == 0:
+                break
+
+            # Drop anything older than what we already have for this command
+            tag = chr(body[0])
+            if seq <= self.udp_recv_seq.get(tag, 0):
+                continue
+            self.udp_recv_seq[tag] = seq
+
+            try:
+                args = decode_binary(self.lobby.lobbyN, body)
+            except (KeyError, IndexError, struct.error, AttributeError):
+                print(f"Invalid datagram message: {body!r}")
+                continue
+            self.server.model.enqueue(self.server.model.on_data, self, (args,))
+
+    def set_protocol(self, version):
+        # Tell the client which protocol we'll use, then switch to it
+        self.send(VERSION, str(version))
+        self.send_protocol = version
 
 
 class Trap:
@@ -103,7 +362,10 @@ class Lobby:
         self.lobbyN = lobbyN
         self.running = True
         self.game_started = False
-        self.traps = []
+        # Placed traps by ID. IDs go up and wrap around at TRAP_ID_COUNT,
+        # skipping any still placed.
+        self.traps = {}
+        self.next_trap_id = 0
         self.fnmap = {
             POSITION: self.on_position,
             ROOM: self.on_room_change,
@@ -113,6 +375,9 @@ class Lobby:
             FACING: self.on_facing,
             ITEMTAKEN: self.on_item_taken,
             ATTACK: self.on_attack,
+            INPUT: self.on_input,
+            PING: self.on_ping,
+            GAMESTATE: self.on_game_state,
         }
         thread = threading.Thread(target=self.run)
         thread.daemon = True
@@ -166,13 +431,38 @@ class Lobby:
             other.send(FACING, str(client.playerN), str(facing))
 
     def on_connect(self, client):
-        if self.game_started:
+        # Two players at most. Once the game has started, a player who
+        # dropped can join again and take their place. Returns whether the
+        # client was let in.
+        if len(self.clients) >= 2:
             client.send(KICK, "The lobby is full.")
-        
+            return False
+
+        client.late = self.game_started
         self.clients.append(client)
 
         if len(self.clients) == 2:
             self.game_started = True
+        return True
+
+    def request_game_state(self, client):
+        # A player joining a game that already started gets the game state
+        # from the other player's client
+        if not getattr(client, "late", False) or not client.accepted & FEATURE_GAMESTATE:
+            return
+
+        for other in self.clients:
+            if other is not client and getattr(other, "accepted", 0) & FEATURE_GAMESTATE:
+                client.awaiting_game_state = True
+                other.send(GAMESTATEREQUEST)
+                return
+
+    def on_game_state(self, client, game_state):
+        # Pass it on to the players waiting for it
+        for other in self.clients:
+            if getattr(other, "awaiting_game_state", False):
+                other.awaiting_game_state = False
+                other.send(GAMESTATE, game_state)
     
     def on_disconnect(self, client):
         try:
@@ -225,13 +515,21 @@ class Lobby:
         if not hasattr(client, "playerN"):
             client.playerN = playerN
 
-        self.traps.append(Trap(playerN, roomN, x, y))
+        if len(self.traps) >= TRAP_ID_COUNT:
+            print("Too many traps")
+            return
+        while self.next_trap_id in self.traps:
+            self.next_trap_id = (self.next_trap_id + 1) % TRAP_ID_COUNT
+        trap_id = self.next_trap_id
+        self.next_trap_id = (trap_id + 1) % TRAP_ID_COUNT
+        self.traps[trap_id] = Trap(playerN, roomN, x, y)
 
         for other in self.clients:
             # if not hasattr(other, "playerN") or other.playerN == client.playerN:
                 # continue
 
-            other.send(TRAP, str(playerN), str(trapN), str(roomN), str(x), str(y))
+            other.send(TRAP, str(playerN), str(trapN), str(roomN), str(x),
+                       str(y), str(trap_id))
 
     def on_trap_activated(self, client, trapN):
         try:
@@ -240,10 +538,11 @@ class Lobby:
             print(f"Invalid trap activation data: {trapN}")
             return
 
-        if trapN < 0 or trapN >= len(self.traps):
+        # Both players can run into a trap at once. Only the first counts.
+        if trapN not in self.traps:
             return
 
-        trap = self.traps[trapN]
+        del self.traps[trapN]
         for other in self.clients:
             other.send(TRAPACTIVATED, str(trapN))
 
@@ -263,14 +562,49 @@ class Lobby:
             client.playerN = playerN
 
         self.positions[playerN] = (x, y)
+        # Push the new position to the other players. Clients only send
+        # their position when it changes (plus a slow heartbeat), so the
+        # other players can't rely on getting it back as a reply.
         for other in self.clients:
             if not hasattr(other, "playerN") or other.playerN == client.playerN:
                 continue
 
-            otherPos = self.positions[other.playerN]
-            client.send(
-                POSITION, str(other.playerN), str(otherPos[0]), str(otherPos[1])
-            )
+            other.send(POSITION, str(playerN), str(x), str(y), server_time())
+
+    def on_ping(self, client, seq):
+        # Answer right away, so the client can measure the round trip
+        client.send(PONG, seq)
+
+    def on_input(self, client, playerN, seq, keys, duration):
+        try:
+            playerN = int(playerN)
+            seq = int(seq)
+            keys = int(keys)
+            duration = int(duration)
+        except ValueError:
+            print(f"Invalid input data: {playerN}, {seq}, {keys}, {duration}")
+            return
+
+        if playerN < 0 or playerN >= len(self.positions):
+            return
+
+        if not hasattr(client, "playerN"):
+            client.playerN = playerN
+
+        # Move the player the same way the client did, and tell it where
+        # the input left it so it can check its prediction
+        x, y = self.positions[playerN]
+        x, y, room = move_player(x, y, self.rooms[playerN], keys,
+                                 duration / 1000.0)
+        self.positions[playerN] = (x, y)
+        self.rooms[playerN] = room
+        client.send(INPUTACK, str(seq), str(x), str(y), str(room))
+
+        for other in self.clients:
+            if not hasattr(other, "playerN") or other.playerN == client.playerN:
+                continue
+
+            other.send(POSITION, str(playerN), str(x), str(y), server_time())
 
 
 class Model:
@@ -283,10 +617,38 @@ class Model:
         self.fnmap = {
             JOINLOBBY: self.on_joinlobby,
         }
+        self.udp_socket = None
+        self.udp_clients = {}
 
-    def on_joinlobby(self, client, lobbyN):
+    def run_udp(self):
+        while self.running:
+            try:
+                datagram, addr = self.udp_socket.recvfrom(DATAGRAM_MAX)
+            except OSError:
+                continue
+
+            if len(datagram) < CLIENT_DATAGRAM_HEADER.size:
+                continue
+
+            token, seq = CLIENT_DATAGRAM_HEADER.unpack_from(datagram)
+            client = self.udp_clients.get(token)
+            if client is None:
+                continue
+
+            client.on_datagram(addr, seq, datagram[CLIENT_DATAGRAM_HEADER.size:])
+
+    def start_udp(self, host, port):
+        self.udp_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.udp_socket.bind((host, port))
+        thread = threading.Thread(target=self.run_udp)
+        thread.daemon = True
+        thread.start()
+
+    def on_joinlobby(self, client, lobbyN, version="0", features="0"):
         try:
             lobbyN = int(lobbyN)
+            version = int(version)
+            features = int(features)
         except ValueError:
             print(f"Invalid lobby number: {lobbyN}")
             return
@@ -296,9 +658,37 @@ class Model:
             new_lobby = Lobby(self, lobbyN)
             self.lobbies[lobbyN] = new_lobby
 
+        # A client that was kicked isn't part of the lobby, so it gets
+        # nothing else
         lobby = self.lobbies[lobbyN]
+        if not lobby.on_connect(client):
+            return
         client.lobby = lobby
-        client.lobby.on_connect(client)
+
+        # The UDP channel carries binary frames, so it needs the binary
+        # protocol. Hand out a token the client puts on every datagram.
+        if (features & FEATURE_UDP and version >= PROTOCOL_BINARY
+                and self.udp_socket is not None):
+            client.udp_token = secrets.randbits(32)
+            self.udp_clients[client.udp_token] = client
+            client.send(UDPTOKEN, str(client.udp_token))
+
+        # Tell the client which of the features it asked for it will get.
+        # Game states only fit in the binary protocol.
+        accepted = features & (FEATURE_PREDICTION | FEATURE_PING)
+        if hasattr(client, "udp_token"):
+            accepted |= FEATURE_UDP
+        if features & FEATURE_GAMESTATE and version >= PROTOCOL_BINARY:
+            accepted |= FEATURE_GAMESTATE
+        client.accepted = accepted
+        client.send(FEATURES, str(accepted))
+
+        # Old clients don't send a version and stay on the text protocol
+        if version > PROTOCOL_TEXT:
+            client.set_protocol(min(version, PROTOCOL_VERSION))
+
+        # Joining late, so catch up on the game so far
+        lobby.request_game_state(client)
     
     def on_deletelobby(self, lobbyN):
         print(f"Deleting lobby {lobbyN}")
@@ -314,6 +704,8 @@ class Model:
         print(f"Client {client.ip}:{client.port} disconnected")
         if hasattr(client, "lobby"):
             client.lobby.on_disconnect(client)
+        if hasattr(client, "udp_token"):
+            self.udp_clients.pop(client.udp_token, None)
         
         self.clients.remove(client)
 
@@ -388,6 +780,7 @@ if __name__ == "__main__":
 
     model = Model()
     model.start()
+    model.start_udp(HOST, PORT)
     server = Server((HOST, PORT), Client)
     server.model = model
 
@@ -24,21 +24,41 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Socket headers. Everything platform specific beyond these lives behind
+// net.h.
+#ifdef _WIN32
 // Defining WIN32_LEAN_AND_MEAN omits winsock from windows.h
 // This allows winsock2 to be included separately
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
 
 // Includes from project
 #include "client.h"
+#include "net.h"
+#include "protocol.h"
 #include "tinycthread.h"
 
 // Constants for networking.
 #define PORT "3490"
 #define RECV_SIZE 4096
 #define QUEUE_SIZE 1048576
+#define DATAGRAM_QUEUE_SIZE 65536
+// How long the recieving thread waits for data before checking if the
+// client was stopped.
+#define RECV_TIMEOUT_MS 100
+// Seconds between pings, and how long to wait for a pong before giving up
+// on it
+#define PING_INTERVAL 1.0
+#define PING_TIMEOUT 5.0
 
 // Get in_addr or in6_addr pointer from sockaddr, checking IPv4 or IPv6.
 void *get_in_addr(struct sockaddr *sa) {
@@ -49,16 +69,34 @@ void *get_in_addr(struct sockaddr *sa) {
     return &(((struct sockaddr_in6 *)sa)->sin6_addr);
 }
 
+// Read and write the little-endian u32s in datagram headers
+static unsigned int readU32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+static void writeU32(unsigned char *p, unsigned int value) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
 // Send entire message to server, retrying when partial message is sent.
 int clientSendAll(Client *self, char *data, int length) {
+    double start = netTime();
     int bytesSent = 0;
     int bytesLeft = length;
 
     while (bytesSent < length) {
         int sent;
         // Returns -1 on error, and number of bytes sent on success.
-        if ((sent = send(self->sockfd, data, bytesLeft, 0)) == -1) {
-            printf("%d\n", WSAGetLastError());
+        if ((sent = send(self->sockfd, data + bytesSent, bytesLeft, 0)) ==
+            -1) {
+            // The socket is non-blocking, so a full send buffer shows up as
+            // an error. Wait until there's room and try again.
+            if (netWouldBlock()) {
+                netWaitWritable(self->sockfd, RECV_TIMEOUT_MS);
+                continue;
+            }
+            printf("%d\n", netLastError());
             perror("send");
             return 1;
         }
@@ -67,73 +105,495 @@ int clientSendAll(Client *self, char *data, int length) {
         bytesSent += sent;
     }
 
+    statsSend(&self->stats, netTime() - start);
     return 0;
 }
 
-// Read all messages from queue (not network).
-// By far the most confusing function in the game.
-char *clientRecvAll(Client *self) {
-    // Resulting message
-    char *result = NULL;
-
-    // Lock queue mutex. Prevents race conditions.
-    mtx_lock(&self->mutex);
-
-    // Pointer to beginning of last message
-    // Start at end of queue
-    char *p = self->queue + self->qsize - 1;
-    // Back up pointer until end of the end of the last message is reached.
-    // If there are no messages, p will end up being queue - 1 (notice the >=)
-    while (p >= self->queue && *p != '\n') {
-        p--;
-    }
-
-    // This code is pretty confusing, so here's a graphic of the queue to make
-    // it clearer. |message message message \n incoming message|
-    //  ^- Read all these          ^- Ignore partial messages
-
-    // If p is smaller than the queue, there are no messages to be read.
-    if (p >= self->queue) {
-        // Length of the messages
-        int length = p - self->queue + 1;
-        // Allocate a new result buffer (account for null terminator)
-        result = malloc(sizeof(char) * (length + 1));
-        // Copy the remaining characters into the result
-        memcpy(result, self->queue, sizeof(char) * length);
-        // Add a null terminator
-        result[length] = '\0';
-
-        // Calculate how many characters have yet to be read
-        int remaining = self->qsize - length;
-        // Move remaining characters to the start of the queue, getting rid of
-        // the read characters in the process
-        memmove(self->queue, p + 1, remaining);
-        // The queue shrank, so update the queue size.
-        self->qsize -= length;
-    }
-    // Unlock the mutex.
-    mtx_unlock(&self->mutex);
+// Add a message to the outbox. Messages are sent together by clientFlush,
+// so a frame's worth of updates costs one send instead of one per message.
+int clientQueue(Client *self, const char *data, int length) {
+    // Make room by sending what's already queued
+    if (self->outboxSize + length > OUTBOX_SIZE) {
+        if (clientFlush(self)) {
+            return 1;
+        }
+    }
+
+    // Messages larger than the outbox are sent right away
+    if (length > OUTBOX_SIZE) {
+        return clientSendAll(self, (char *)data, length);
+    }
+
+    memcpy(self->outbox + self->outboxSize, data, length);
+    self->outboxSize += length;
+    return 0;
+}
+
+// Queue a ping if it's time to measure the round trip again. The pong is
+// picked up by clientNextMessage, so the time includes up to a frame of
+// waiting to be read.
+static void queuePing(Client *self) {
+    NetStats *stats = &self->stats;
+    if (!(self->acceptedFeatures & FEATURE_PING)) {
+        return;
+    }
+
+    double now = netTime();
+    double wait = stats->pingWaiting ? PING_TIMEOUT : PING_INTERVAL;
+    if (now - stats->pingSentAt < wait) {
+        return;
+    }
+
+    // Mark the ping as sent first, since sending can flush (and get back
+    // here) when the outbox is full
+    stats->pingSentAt = now;
+    stats->pingWaiting = true;
+    Command command = {.type = COMMAND_PING,
+                       .sequence = ++stats->pingSequence};
+    clientSendCommand(self, self->lobby, &command);
+}
+
+// Send every message in the outbox, and the UDP outbox as one datagram.
+int clientFlush(Client *self) {
+    // Not connected (a replay being played back), so nothing can be sent
+    if (self->sockfd == NET_INVALID_SOCKET) {
+        self->outboxSize = 0;
+        self->udpOutboxSize = 0;
+        return 0;
+    }
+
+    queuePing(self);
+
+    // A datagram that's lost is simply replaced by a newer one, so errors
+    // (including a full send buffer) are ignored.
+    if (self->udpOutboxSize > 0) {
+        writeU32((unsigned char *)self->udpOutbox, self->udpToken);
+        writeU32((unsigned char *)self->udpOutbox + 4,
+                 ++self->udpSendSequence);
+        send(self->udpfd, self->udpOutbox, self->udpOutboxSize, 0);
+        self->udpOutboxSize = 0;
+    }
+
+    if (self->outboxSize == 0) {
+        return 0;
+    }
+
+    int result = clientSendAll(self, self->outbox, self->outboxSize);
+    self->outboxSize = 0;
     return result;
 }
 
-// A function called in a separate thread. Recieves messages from network
+// Point message at length bytes starting offset bytes into a queue.
+// Nothing is copied unless the bytes wrap around the end of the queue, in
+// which case they are copied into the queue's wrapped buffer. When
+// terminate is true, the byte after the message (its '\n') is replaced by a
+// null terminator. This is safe because the recieving thread never writes
+// to bytes that haven't been released.
+static void pointAtMessage(MessageQueue *queue, ClientMessage *message,
+                           size_t offset, size_t length, bool terminate) {
+    size_t contiguous;
+    char *p = ringReadPtr(&queue->ring, offset, &contiguous);
+
+    if (contiguous > length) {
+        // The message and the byte after it are in one piece.
+        if (terminate) p[length] = '\0';
+        message->data = p;
+    } else {
+        // The message wraps around. Copy it out, dropping anything that
+        // doesn't fit.
+        size_t copied = length < MESSAGE_MAX - 1 ? length : MESSAGE_MAX - 1;
+        ringCopyOut(&queue->ring, offset, queue->wrapped, copied);
+        queue->wrapped[copied] = '\0';
+        message->data = queue->wrapped;
+        length = copied;
+    }
+
+    message->length = (int)length;
+}
+
+// Get the next line of the text protocol.
+static bool nextTextMessage(Client *self, MessageQueue *queue,
+                            ClientMessage *message) {
+    // Search for the end of the next message. The search is split in two
+    // when the readable bytes wrap around the end of the queue.
+    size_t start = queue->readOffset;
+    size_t end = start;
+    bool found = false;
+    while (end < queue->readLimit) {
+        size_t contiguous;
+        char *p = ringReadPtr(&queue->ring, end, &contiguous);
+        if (contiguous > queue->readLimit - end) {
+            contiguous = queue->readLimit - end;
+        }
+
+        char *newline = memchr(p, '\n', contiguous);
+        if (newline) {
+            end += newline - p;
+            found = true;
+            break;
+        }
+        end += contiguous;
+    }
+
+    // Only a partial message (or nothing) is left
+    if (!found) {
+        return false;
+    }
+
+    pointAtMessage(queue, message, start, end - start, true);
+    message->protocol = PROTOCOL_TEXT;
+    // Skip past the '\n'
+    queue->readOffset = end + 1;
+    return true;
+}
+
+// Get the next frame of the binary protocol.
+static bool nextBinaryMessage(Client *self, MessageQueue *queue,
+                              ClientMessage *message) {
+    size_t available = queue->readLimit - queue->readOffset;
+    if (available < FRAME_HEADER_SIZE) {
+        return false;
+    }
+
+    // Read the little-endian length, which may itself wrap around
+    unsigned char header[FRAME_HEADER_SIZE];
+    ringCopyOut(&queue->ring, queue->readOffset, (char *)header,
+                FRAME_HEADER_SIZE);
+    size_t length = header[0] | (header[1] << 8);
+
+    // Only part of the frame has arrived
+    if (available < FRAME_HEADER_SIZE + length) {
+        return false;
+    }
+
+    pointAtMessage(queue, message, queue->readOffset + FRAME_HEADER_SIZE,
+                   length, false);
+    message->protocol = PROTOCOL_BINARY;
+    queue->readOffset += FRAME_HEADER_SIZE + length;
+    return true;
+}
+
+// Add a binary frame to the UDP outbox, sending the outbox first if it's
+// full.
+static int queueDatagramFrame(Client *self, int lobby, const Command *command) {
+    // Leave room for the token and sequence number
+    if (self->udpOutboxSize == 0) {
+        self->udpOutboxSize = 8;
+    }
+
+    int length = encodeCommand(command, PROTOCOL_BINARY, lobby,
+                               self->udpOutbox + self->udpOutboxSize,
+                               DATAGRAM_MAX - self->udpOutboxSize);
+    if (length == -1) {
+        clientFlush(self);
+        self->udpOutboxSize = 8;
+        length = encodeCommand(command, PROTOCOL_BINARY, lobby,
+                               self->udpOutbox + self->udpOutboxSize,
+                               DATAGRAM_MAX - self->udpOutboxSize);
+    }
+    if (length < 0) {
+        return 1;
+    }
+
+    statsCount(self->stats.sent, command->type, length);
+    self->udpOutboxSize += length;
+    return 0;
+}
+
+// Encode a command into the outbox using the negotiated protocol.
+int clientSendCommand(Client *self, int lobby, const Command *command) {
+    // Position and facing are replaced by the next update anyway, so they
+    // don't need TCP's retransmission (or its head-of-line blocking).
+    // With prediction a position is only sent when the player teleports,
+    // and it has to reach the server in order with the inputs.
+    bool teleport = (self->acceptedFeatures & FEATURE_PREDICTION) &&
+                    command->type == COMMAND_POSITION;
+    if (self->udpActive && !teleport &&
+        (command->type == COMMAND_POSITION ||
+         command->type == COMMAND_FACING)) {
+        return queueDatagramFrame(self, lobby, command);
+    }
+
+    int length =
+        encodeCommand(command, self->sendProtocol, lobby,
+                      self->outbox + self->outboxSize,
+                      OUTBOX_SIZE - self->outboxSize);
+
+    // Make room by sending what's already queued, then try again. A
+    // command that can't be encoded at all is dropped without flushing.
+    if (length == -1) {
+        if (clientFlush(self)) {
+            return 1;
+        }
+        length = encodeCommand(command, self->sendProtocol, lobby,
+                               self->outbox, OUTBOX_SIZE);
+    }
+    if (length < 0) {
+        return 1;
+    }
+
+    // Remember the lobby for pings
+    if (command->type == COMMAND_JOIN) {
+        self->lobby = command->lobby;
+    }
+
+    statsCount(self->stats.sent, command->type, length);
+    self->outboxSize += length;
+    return 0;
+}
+
+// Handle the negotiation lines the server sends after a lobby join. Returns
+// true if message was one of them.
+static bool negotiate(Client *self, ClientMessage *message) {
+    // Every text message comes through here, so only decode the ones with
+    // a negotiation tag
+    Command command;
+    if (message->protocol != PROTOCOL_TEXT || message->length < 1 ||
+        !strchr("UEV", message->data[0]) ||
+        !decodeCommand(message->data, message->length, PROTOCOL_TEXT,
+                       &command)) {
+        return false;
+    }
+
+    switch (command.type) {
+        // The server accepted the UDP channel, and gave us a token to put
+        // on every datagram. Send one right away so the server learns our
+        // address.
+        case COMMAND_UDPTOKEN:
+            if (self->features & FEATURE_UDP) {
+                self->udpToken = command.token;
+                self->udpActive = true;
+                self->udpOutboxSize = 8;
+                clientFlush(self);
+            }
+            return true;
+
+        // Features the server accepted
+        case COMMAND_FEATURES:
+            self->acceptedFeatures = command.features & self->features;
+            return true;
+
+        // The server confirmed which protocol to use. Everything it sends
+        // after this line uses the new protocol. Answer with our own
+        // version line, after which everything we send uses it too.
+        case COMMAND_VERSION: {
+            int version = command.version;
+            if (version > PROTOCOL_VERSION) {
+                version = PROTOCOL_TEXT;
+            }
+
+            Command reply = {.type = COMMAND_VERSION, .version = version};
+            clientSendCommand(self, 0, &reply);
+            self->recvProtocol = version;
+            self->sendProtocol = version;
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+// Measure the round trip time with a pong. Returns true if message was one.
+static bool handlePong(Client *self, ClientMessage *message) {
+    Command command;
+    if (message->length < 1 || message->data[0] != COMMAND_PONG ||
+        !decodeCommand(message->data, message->length, message->protocol,
+                       &command)) {
+        return false;
+    }
+
+    NetStats *stats = &self->stats;
+    if (stats->pingWaiting && command.sequence == stats->pingSequence) {
+        statsRoundTrip(stats, netTime() - stats->pingSentAt);
+        stats->pingWaiting = false;
+    }
+    return true;
+}
+
+// Count a recieved message, with its framing
+static void countRecieved(Client *self, ClientMessage *message) {
+    int framing =
+        message->protocol == PROTOCOL_BINARY ? FRAME_HEADER_SIZE : 1;
+    int tag = message->length > 0 ? (unsigned char)message->data[0] : 0;
+    statsCount(self->stats.recieved, tag, message->length + framing);
+}
+
+// Get the next message from queue (not network).
+// Messages are returned in place and point into the queue. Nothing is
+// allocated or copied unless the message wraps around the end of the queue.
+// TCP messages come first, then anything recieved over UDP.
+bool clientNextMessage(Client *self, ClientMessage *message) {
+    // Take a snapshot of the published bytes when iteration starts.
+    // Anything recieved after this is picked up next frame, which keeps one
+    // frame from being stuck draining a busy connection.
+    if (self->queue.readOffset == 0) {
+        self->queue.readLimit = ringReadable(&self->queue.ring);
+        if (self->queue.readLimit > self->stats.queueHighWater) {
+            self->stats.queueHighWater = self->queue.readLimit;
+        }
+    }
+    if (self->datagrams.readOffset == 0 && self->datagrams.ring.data) {
+        self->datagrams.readLimit = ringReadable(&self->datagrams.ring);
+        self->stats.datagramFramesDropped =
+            atomic_load(&self->udpFramesDropped);
+    }
+
+    while (1) {
+        bool found = self->recvProtocol == PROTOCOL_BINARY
+                         ? nextBinaryMessage(self, &self->queue, message)
+                         : nextTextMessage(self, &self->queue, message);
+        if (!found) {
+            break;
+        }
+
+        countRecieved(self, message);
+        if (!negotiate(self, message) && !handlePong(self, message)) {
+            return true;
+        }
+    }
+
+    if (self->datagrams.ring.data &&
+        nextBinaryMessage(self, &self->datagrams, message)) {
+        countRecieved(self, message);
+        return true;
+    }
+    return false;
+}
+
+// Give read messages back to the recieving thread. The partial message at the
+// end of the queue stays where it is, so nothing has to be moved.
+void clientReleaseMessages(Client *self) {
+    ringConsume(&self->queue.ring, self->queue.readOffset);
+    self->queue.readOffset = 0;
+    self->queue.readLimit = 0;
+
+    if (self->datagrams.ring.data) {
+        ringConsume(&self->datagrams.ring, self->datagrams.readOffset);
+    }
+    self->datagrams.readOffset = 0;
+    self->datagrams.readLimit = 0;
+}
+
+// Read all waiting datagrams. Frames from a datagram older than one already
+// recieved for the same command and player are dropped, and the rest are
+// copied into the datagram queue. Frames that don't fit are counted and
+// dropped.
+static void pumpDatagrams(Client *self) {
+    unsigned char datagram[DATAGRAM_MAX];
+
+    while (1) {
+        int length = recv(self->udpfd, (char *)datagram, DATAGRAM_MAX, 0);
+        if (length < 4) {
+            // Nothing left (or a datagram too short to have a sequence)
+            if (length < 0) return;
+            continue;
+        }
+
+        // Decide once per datagram whether it's newer than what was seen
+        // for each command and player, so a datagram with several frames
+        // for the same one keeps all of them. Compare as signed so the
+        // sequence can wrap around.
+        unsigned int sequence = readU32(datagram);
+        bool newer[2][2];
+        for (int kind = 0; kind < 2; kind++) {
+            for (int player = 0; player < 2; player++) {
+                newer[kind][player] =
+                    (int)(sequence - self->udpRecvSequence[kind][player]) > 0;
+            }
+        }
+        int offset = 4;
+
+        // Walk the frames in the datagram
+        while (offset + FRAME_HEADER_SIZE + 2 <= length) {
+            int frameLength = datagram[offset] | (datagram[offset + 1] << 8);
+            int frameSize = FRAME_HEADER_SIZE + frameLength;
+            if (frameLength < 2 || offset + frameSize > length) {
+                break;
+            }
+
+            // Position and facing frames start with the tag and player
+            unsigned char tag = datagram[offset + FRAME_HEADER_SIZE];
+            unsigned char player = datagram[offset + FRAME_HEADER_SIZE + 1];
+            int kind = tag == COMMAND_POSITION ? 0
+                       : tag == COMMAND_FACING ? 1
+                                               : -1;
+
+            if (kind != -1 && player < 2 && newer[kind][player]) {
+                self->udpRecvSequence[kind][player] = sequence;
+                if (!ringWrite(&self->datagrams.ring,
+                               (char *)datagram + offset, frameSize)) {
+                    atomic_fetch_add(&self->udpFramesDropped, 1);
+                }
+            }
+
+            offset += frameSize;
+        }
+    }
+}
+
+// Read everything waiting on the sockets into the queues, without blocking.
+int clientPump(Client *self) {
+    int total = 0;
+
+    if (self->udpfd != NET_INVALID_SOCKET) {
+        pumpDatagrams(self);
+    }
+
+    while (1) {
+        // Get free space in the queue. recv writes straight into it, so
+        // there's no intermediate buffer to copy from.
+        size_t space;
+        char *data = ringWritePtr(&self->queue.ring, &space);
+
+        // The queue is full. The rest waits until the game thread reads.
+        if (space == 0) {
+            return total;
+        }
+
+        // Don't ask for more than RECV_SIZE at once
+        if (space > RECV_SIZE) {
+            space = RECV_SIZE;
+        }
+
+        // Length is returned by the recv function. Returns 0 if the socket
+        // is disconnected, and a negative number on error (including when
+        // there's nothing left to read).
+        int length = recv(self->sockfd, data, (int)space, 0);
+        if (length == 0) {
+            return -1;
+        } else if (length < 0) {
+            return netWouldBlock() ? total : -1;
+        }
+
+        // Publish the new bytes to the game thread
+        ringCommitWrite(&self->queue.ring, length);
+        total += length;
+    }
+}
+
+// A function called in a separate thread. Waits for messages from network
 // and writes them to queue.
 int recvWorker(void *selfVoidPtr) {
     // Arguments must be passed in void pointers when creating a thread.
     // Cast client back from void pointer.
     Client *self = (Client *)selfVoidPtr;
 
-    // Allocate buffer.
-    char *data = malloc(sizeof(char) * RECV_SIZE);
+    // Wait on the TCP socket, and the UDP socket if there is one
+    NetSocket sockets[2] = {self->sockfd, self->udpfd};
+    int socketCount = self->udpfd != NET_INVALID_SOCKET ? 2 : 1;
 
     // While the client is running, recieve messages
     while (self->running) {
-        // While the client is running, recieve messages
-        int length;
+        // Wait until there's something to read. The timeout lets the thread
+        // notice when the client is stopped.
+        int ready = netWaitAnyReadable(sockets, socketCount, RECV_TIMEOUT_MS);
+        if (ready == 0) {
+            continue;
+        }
 
-        // Length is returned by the recv function. Returns a negative
-        // number on error (or if the socket is disconnected).
-        if ((length = recv(self->sockfd, data, RECV_SIZE - 1, 0)) <= 0) {
+        int length = ready < 0 ? -1 : clientPump(self);
+        if (length < 0) {
             // Print error if recv failed and the client wasn't stopped
             if (self->running) {
                 perror("recv");
@@ -144,33 +604,16 @@ int recvWorker(void *selfVoidPtr) {
             }
         }
 
-        while (1) {
-            int done = 0;
-            // Lock the mutex
-            mtx_lock(&self->mutex);
-
-            // If the queue has enough space for the message, copy it in.
-            // If not, loop until there is enough space (the queue will shrink
-            // as messages are read).
-            if (self->qsize + length < QUEUE_SIZE) {
-                memcpy(self->queue + self->qsize, data,
-                       sizeof(char) * (length + 1));
-                self->qsize += length;
-                done = 1;
-            }
-
-            mtx_unlock(&self->mutex);
-            if (done) break;
-
-            // Wait until the end of allocated time slice.
-            // This waits for the recieving thread to run instad of looping
-            // until the time slice ends.
-            Sleep(0);
+        // If the queue is full, wait until the game thread reads from it.
+        // Yielding lets the game thread run instead of looping until the
+        // time slice ends.
+        size_t space;
+        ringWritePtr(&self->queue.ring, &space);
+        if (length == 0 && space == 0) {
+            thrd_yield();
         }
     }
 
-    // Free buffer
-    free(data);
     return 0;
 }
 
@@ -216,7 +659,8 @@ int clientConnect(Client *self, char *hostname, int port) {
 
         // Try to create a socket. Try another IP on fail.
         if ((self->sockfd = socket(iterator->ai_family, iterator->ai_socktype,
-                                   iterator->ai_protocol)) == -1) {
+                                   iterator->ai_protocol)) ==
+            NET_INVALID_SOCKET) {
             perror("client: socket");
             continue;
         }
@@ -224,7 +668,7 @@ int clientConnect(Client *self, char *hostname, int port) {
         // Try connecting. Try other IP if failed.
         if (connect(self->sockfd, iterator->ai_addr, iterator->ai_addrlen) ==
             -1) {
-            closesocket(self->sockfd);
+            netClose(self->sockfd);
             perror("client: connect");
             continue;
         }
@@ -244,17 +688,57 @@ int clientConnect(Client *self, char *hostname, int port) {
               serverIPAddress, sizeof serverIPAddress);
     printf("client: connecting to %s\n", serverIPAddress);
 
+    // Disable Nagle's algorithm. Messages are already batched once per frame
+    // by clientFlush, so waiting for more data only adds latency.
+    int noDelay = 1;
+    if (setsockopt(self->sockfd, IPPROTO_TCP, TCP_NODELAY, (char *)&noDelay,
+                   sizeof(noDelay)) == -1) {
+        perror("setsockopt");
+    }
+
+    // Open the UDP side channel to the same address and port. connect()
+    // on a UDP socket just sets the default destination, and filters out
+    // datagrams from anyone else. The server decides whether to use it when
+    // we join a lobby.
+    self->udpfd = socket(iterator->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (self->udpfd == NET_INVALID_SOCKET ||
+        connect(self->udpfd, iterator->ai_addr, iterator->ai_addrlen) == -1) {
+        perror("client: udp");
+        if (self->udpfd != NET_INVALID_SOCKET) {
+            netClose(self->udpfd);
+            self->udpfd = NET_INVALID_SOCKET;
+        }
+        self->features &= ~FEATURE_UDP;
+    }
+
     // Free returned linked list
     freeaddrinfo(serverInfo);  // all done with this structure
+    return 0;
+}
+
+// Allocate queue and make the socket non-blocking
+static void clientPrepare(Client *self) {
+    self->running = true;
+    // Allocate queues
+    if (!ringInit(&self->queue.ring, QUEUE_SIZE) ||
+        !ringInit(&self->datagrams.ring, DATAGRAM_QUEUE_SIZE)) {
+        fprintf(stderr, "Failed to allocate queue\n");
+        exit(1);
+    }
+    // Reads and writes never block. The recieving thread (or the caller of
+    // clientPump) waits for readiness instead.
+    if (netSetNonBlocking(self->sockfd) == -1 ||
+        (self->udpfd != NET_INVALID_SOCKET &&
+         netSetNonBlocking(self->udpfd) == -1)) {
+        perror("client: non-blocking");
+        exit(1);
+    }
 }
 
 // Start client. Allocate queue, and starts thread.
 void clientStart(Client *self) {
-    self->running = true;
-    self->queue = (char *)calloc(QUEUE_SIZE, sizeof(char));
-    self->qsize = 0;
-    // Create queue mutex
-    mtx_init(&self->mutex, mtx_plain);
+    clientPrepare(self);
+    self->threaded = true;
     // Start recieving thread
     if (thrd_create(&self->recv_thread, recvWorker, self) != thrd_success) {
         perror("thrd_create");
@@ -262,18 +746,30 @@ void clientStart(Client *self) {
     }
 }
 
+// Start client without a recieving thread. The caller reads from the network
+// with clientPump when the socket is readable.
+void clientStartPolled(Client *self) {
+    clientPrepare(self);
+    self->threaded = false;
+}
+
 // Stop client. Stops recieving thread and frees varaibles.
 void clientStop(Client *self) {
     // Settting running to false will break out of the recieving loop
     // on the next iteration.
     self->running = false;
-    // Disconnect
-    closesocket(self->sockfd);
     // Wait until recieving thread exits
-    thrd_join(self->recv_thread, NULL);
+    if (self->threaded) {
+        thrd_join(self->recv_thread, NULL);
+    }
+    // Disconnect
+    netClose(self->sockfd);
+    if (self->udpfd != NET_INVALID_SOCKET) {
+        netClose(self->udpfd);
+    }
     // Free variables
-    free(self->queue);
-    mtx_destroy(&self->mutex);
+    ringFree(&self->queue.ring);
+    ringFree(&self->datagrams.ring);
 }
 
 // Free client struct
@@ -281,34 +777,33 @@ void clientFree(Client *self) { free(self); }
 
 // Create client
 Client *clientInit() {
-    // Setup for windows sockets
-    WSADATA wsaData;
-
-    // Initialize winsock and check for errors
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        fprintf(stderr, "WSAStartup failed.\n");
-        exit(1);
-    }
-
-    // Check if Winsock 2.2 is available
-    if (LOBYTE(wsaData.wVersion) != 2 || HIBYTE(wsaData.wVersion) != 2) {
-        fprintf(stderr, "Versiion 2.2 of Winsock is not available.\n");
-        WSACleanup();
-        exit(2);
-    }
-
-    printf("Winsock initialized.\n");
-
-    // Run cleanup at program exit
-    atexit((void (*)(void))WSACleanup);
+    // Setup for platform sockets
+    netStartup();
 
     // Allocate client
     Client *out = (Client *)malloc(sizeof(Client));
 
     // Initialize client
-    out->sockfd = 0;
-    out->qsize = 0;
-    out->queue = 0;
+    out->sockfd = NET_INVALID_SOCKET;
+    out->threaded = false;
+    memset(&out->queue, 0, sizeof(out->queue));
+    memset(&out->datagrams, 0, sizeof(out->datagrams));
+    out->outboxSize = 0;
+    out->recvProtocol = PROTOCOL_TEXT;
+    out->sendProtocol = PROTOCOL_TEXT;
+    out->features =
+        FEATURE_UDP | FEATURE_PREDICTION | FEATURE_PING | FEATURE_GAMESTATE;
+    out->acceptedFeatures = 0;
+    out->udpfd = NET_INVALID_SOCKET;
+    out->udpActive = false;
+    out->udpToken = 0;
+    out->udpSendSequence = 0;
+    memset(out->udpRecvSequence, 0, sizeof(out->udpRecvSequence));
+    atomic_init(&out->udpFramesDropped, 0);
+    out->udpOutboxSize = 0;
+    out->lobby = 0;
+    memset(&out->stats, 0, sizeof(out->stats));
+    out->stats.queueCapacity = QUEUE_SIZE;
     out->running = false;
 
     return out;
@@ -14,97 +14,102 @@
 #include <string.h>
 
 #include "game.h"
+#include "replay.h"
+#include "serialize.h"
 
-// Run command given over the network.
-// Alters GameState.
-int run_commands(char* commands, GameState* state) {
-    // Declare variables. These will be used in scanf's when processing
-    // commands.
-    // I'm aware that this method is a little weird, but this is what
-    // by reference Craft uses.
-    // https://github.com/fogleman/Craft/blob/master/src/main.c#L2471
-    char kickReason[101];
-    int pid, room;
-    float px, py;
-    float gameTime;
-    int trapData, trapRoom, trapOwner, trapN;
-    float trapX, trapY;
-    float damage;
-
-    int facing, playerN, winner, furnitureN, itemN;
-
-    long long int startTime;
-
-    // Commands is a long string will all of the queued commands separated by
-    // \n. Tokenize commands using strtok_r (threadsafe version of strtok).
-    char* key = commands;
-    char* command = strtok_r(commands, "\n", &key);
+// Check that numbers given over the network can be used as indexes
+static bool validPlayer(int player) { return player >= 0 && player < 2; }
 
-    // While there are still commands
-    while (command != NULL) {
-        // Parse commands. Each time, check if sscanf scanned all tokens.
-        if (sscanf(command, "P,%d,%f,%f", &pid, &px, &py) == 3) {
+// Apply a decoded command given over the network.
+// Alters GameState.
+int applyCommand(const Command* command, GameState* state) {
+    switch (command->type) {
+        case COMMAND_POSITION: {
             // Change position
             // Params: pid: player id. px: position x, py: position y
-            if (pid < 0 || pid >= 2) {
+            if (!validPlayer(command->player)) {
                 return 1;
             }
 
             // Alter gameState
-            Player* player = &state->players[pid];
-            player->pos.x = px;
-            player->pos.y = py;
+            Player* player = &state->players[command->player];
+            player->pos.x = command->x;
+            player->pos.y = command->y;
 
-        } else if (sscanf(command, "R,%d,%d", &pid, &room) == 2) {
+            // Keep the position for interpolation. Without a server time,
+            // use the time it was recieved.
+            if (command->player != state->thisPlayer) {
+                double time =
+                    command->time >= 0.0 ? command->time : state->clock;
+                snapshotPush(&player->snapshots, time, state->clock,
+                             command->x, command->y);
+            }
+            break;
+        }
+        case COMMAND_ROOM: {
             // Change room.
             // Params: pid: player id. room: new room number
 
             // Check validity
-            if (pid < 0 || pid >= 2) {
+            if (!validPlayer(command->player) ||
+                !roomInHouse(state, command->room)) {
                 return 1;
             }
 
             // Change player's room.
-            Player* player = &state->players[pid];
-            player->room = room;
-        } else if (sscanf(command, "T,%d,%d,%d,%f,%f", &trapOwner, &trapData,
-                          &trapRoom, &trapX, &trapY) == 5) {
+            Player* player = &state->players[command->player];
+            player->room = command->room;
+            // Don't interpolate through the door
+            snapshotClear(&player->snapshots);
+            break;
+        }
+        case COMMAND_TRAP: {
             // Set a trap.
-            int trapN;
-            // Find next available trap
-            bool trapFound = false;
-            for (trapN = 0; trapN < TRAP_MAX; trapN++) {
-                if (state->traps[trapN].data == TRAP_NONE) {
-                    trapFound = true;
-                    break;
-                }
+            if (!validPlayer(command->player) ||
+                !roomInHouse(state, command->room) ||
+                command->trapData <= TRAP_NONE ||
+                command->trapData > TRAP_COUNT) {
+                return 1;
             }
 
-            // If no trap found, change the first trap.
-            // Note that this shouldn't be possible (all players can place 3
-            // traps at most)
-            if (!trapFound) {
-                trapN = 0;
+            // Add it to the traps. This fails if the server reused an ID
+            // that's still placed, or if every slot is full, which shouldn't
+            // be possible (all players can place 3 traps at most)
+            if (trapTableAdd(&state->traps, command->trap, command->trapData,
+                             command->player, command->room, command->x,
+                             command->y) < 0) {
+                return 1;
             }
-
-            // Set data on trap
-            state->traps[trapN].pos.x = trapX;
-            state->traps[trapN].pos.y = trapY;
-            state->traps[trapN].room = trapRoom;
-            state->traps[trapN].data = trapData;
-            state->traps[trapN].owner = trapOwner;
-        } else if (sscanf(command, "K,%[^\n]%*c", kickReason) == 1) {
+            break;
+        }
+        case COMMAND_INPUTACK:
+            // Where the server moved this player
+            if (!roomInHouse(state, command->room)) {
+                return 1;
+            }
+            reconcilePrediction(state, command);
+            break;
+        case COMMAND_KICK:
             // If the player is kicked
-            printf("Kicked: %s\n", kickReason);
+            printf("Kicked: %s\n", command->reason);
             state->done = true;
-        } else if (sscanf(command, "I,%d,%d,%d", &playerN, &furnitureN,
-                          &itemN) == 3) {
+            break;
+        case COMMAND_ITEM: {
             // Pick up item
+            if (!validPlayer(command->player) || command->furniture < -1 ||
+                command->furniture >= furnitureCount(state) ||
+                command->item < 0 ||
+                command->item >= FOOD_COUNT) {
+                return 1;
+            }
+
+            int playerN = command->player;
             // furnitureN is -1 when the item is picked up from a dead player.
-            if (furnitureN != -1) state->furniture[furnitureN].food = FOOD_NONE;
+            if (command->furniture != -1)
+                emptyFurniture(state, command->furniture);
 
             // Set item state in player inventory
-            state->players[playerN].foodInventory[itemN] = true;
+            state->players[playerN].foodInventory[command->item] = true;
 
             // Check if player has a full inventory
             bool allFoods = true;
@@ -119,32 +124,301 @@ int run_commands(char* commands, GameState* state) {
             if (allFoods) {
                 state->exitUnlocked = true;
             }
-        } else if (sscanf(command, "C,%f", &damage) == 1) {
+            break;
+        }
+        case COMMAND_ATTACK:
             // On attack
-            state->players[state->thisPlayer].health -= damage;
-        } else if (sscanf(command, "O,%d", &winner) == 1) {
+            state->players[state->thisPlayer].health -= command->damage;
+            break;
+        case COMMAND_GAMEOVER:
             // On game end.
             state->done = true;
             // I could've displayed this to the screen, but didn't have time :(
-            printf("Game over, winner: %d\n", winner);
-        } else if (sscanf(command, "F,%d,%d", &playerN, &facing) == 2) {
+            printf("Game over, winner: %d\n", command->player);
+            break;
+        case COMMAND_FACING:
             // When a player turns
-            state->players[playerN].facing = facing;
-        } else if (sscanf(command, "A,%d", &trapN) == 1) {
-            // When a player activates a trap
-            // If the player owned the trap, add it back to their inventory
-            if (state->traps[trapN].owner == state->thisPlayer) {
-                state->trapInventory[trapN] = true;
+            if (!validPlayer(command->player) || command->facing < 0 ||
+                command->facing >= 4) {
+                return 1;
+            }
+            state->players[command->player].facing = command->facing;
+            break;
+        case COMMAND_TRAPACTIVATED: {
+            // When a player activates a trap. The server names it by ID.
+            int trapN = trapTableFind(&state->traps, command->trap);
+            if (trapN < 0) {
+                return 1;
+            }
+            // If the player owned the trap, add it back to their inventory.
+            // The inventory has one slot per kind of trap.
+            if (trapOwner(state, trapN) == state->thisPlayer) {
+                state->trapInventory[trapData(state, trapN) - 1] = true;
             }
             // Remove trap from game
-            state->traps[trapN].data = TRAP_NONE;
-        } else {
-            // Didn't match any command. Shouldn't be possible.
-            printf("Invalid command: %s\n", command);
+            trapTableRemove(&state->traps, trapN);
+            break;
         }
+        case COMMAND_GAMESTATEREQUEST:
+            // A player is joining. The game state is sent at the end of
+            // the tick.
+            state->gameStateRequested = true;
+            break;
+        case COMMAND_GAMESTATE: {
+            // The game so far, when joining late or coming back
+            if (!deserializeGameState(state, command->gameState.data,
+                                      command->gameState.length)) {
+                return 1;
+            }
 
-        // Go to the next command.
-        command = strtok_r(NULL, "\n", &key);
+            // Carry on from where the other client last saw this player.
+            // Only this client knew its health, so it starts full.
+            Player* player = &state->players[state->thisPlayer];
+            player->health = 100.0f;
+            player->previousPos = player->pos;
+            player->previousRoom = player->room;
+            player->roomChanged = true;
+            // Tell the server where that is
+            predictionTeleport(&state->prediction);
+            state->teleported = true;
+
+            // Don't interpolate the other player from before
+            Player* other = &state->players[!state->thisPlayer];
+            snapshotClear(&other->snapshots);
+            other->previousPos = other->pos;
+            other->previousRoom = other->room;
+            break;
+        }
+        default:
+            // Not a command the server sends. Shouldn't be possible.
+            return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
+
+// Decode a message recieved by the client
+static bool decodeMessage(const ClientMessage* message, Command* command) {
+    if (!decodeCommand(message->data, message->length, message->protocol,
+                       command)) {
+        // Didn't match any command. Shouldn't be possible.
+        printf("Invalid command: %.*s\n",
+               message->protocol == PROTOCOL_TEXT ? message->length : 1,
+               message->data);
+        return false;
+    }
+    return true;
+}
+
+// Run a single message recieved by the client.
+// Alters GameState.
+int run_message(const ClientMessage* message, GameState* state) {
+    Command command;
+    if (!decodeMessage(message, &command)) {
+        return 1;
+    }
+    return applyCommand(&command, state);
+}
+
+// Kinds of commands where only the newest one for each player matters.
+// When the client falls behind, a batch can hold dozens of positions for
+// the same player, so these are held back and only the newest of each is
+// decoded and applied at the end of the batch. The rest are never decoded,
+// so catching up costs little more than reading the tags.
+#define HELD_KINDS 4
+
+// Where a command is held in a batch, or -1 if it's an event that has to be
+// applied in order
+static int heldKind(CommandType type) {
+    switch (type) {
+        case COMMAND_POSITION:
+            return 0;
+        case COMMAND_FACING:
+            return 1;
+        case COMMAND_ROOM:
+            return 2;
+        case COMMAND_INPUTACK:
+            // Acks are cumulative, so the newest replaces the others. They
+            // are always about this player, and are held under player 0.
+            return 3;
+        default:
+            return -1;
+    }
+}
+
+// Which player a held message is about, read without decoding it. It's
+// the first field of P, F and R: the byte after the tag in binary, or a
+// single digit between commas in text. Returns -1 if it isn't written the
+// way the server writes it, and the message has to be decoded to tell.
+static int peekPlayer(const ClientMessage* message, CommandType type) {
+    if (type == COMMAND_INPUTACK) {
+        return 0;
+    }
+    const char* data = message->data;
+    if (message->protocol == PROTOCOL_BINARY) {
+        return message->length > 1 && (data[1] == 0 || data[1] == 1)
+                   ? data[1]
+                   : -1;
+    }
+    if (message->length >= 3 && data[1] == ',' &&
+        (data[2] == '0' || data[2] == '1') &&
+        (message->length == 3 || data[3] == ',')) {
+        return data[2] - '0';
+    }
+    return -1;
+}
+
+// Messages being run together
+typedef struct {
+    // Newest message of each kind, for each player. They point into the
+    // client's queue (or the replay), which is kept until the batch is
+    // finished.
+    ClientMessage held[2][HELD_KINDS];
+    // Where each held command was in the batch, or 0 if there isn't one
+    int order[2][HELD_KINDS];
+    int count;
+} CommandBatch;
+
+// Apply the held commands, in the order they were recieved, so a room
+// change and a position end up the same as if every message had been run.
+static int batchFinish(CommandBatch* batch, GameState* state) {
+    int result = 0;
+    while (true) {
+        // Find the earliest held message left
+        int* next = NULL;
+        const ClientMessage* message = NULL;
+        for (int player = 0; player < 2; player++) {
+            for (int kind = 0; kind < HELD_KINDS; kind++) {
+                int* order = &batch->order[player][kind];
+                if (*order && (!next || *order < *next)) {
+                    next = order;
+                    message = &batch->held[player][kind];
+                }
+            }
+        }
+        if (!next) {
+            break;
+        }
+
+        *next = 0;
+        Command command;
+        result |= decodeMessage(message, &command)
+                      ? applyCommand(&command, state)
+                      : 1;
+    }
+    return result;
+}
+
+// Add a message to a batch. Events are applied right away, so they keep
+// their order.
+static int batchAdd(CommandBatch* batch, const ClientMessage* message,
+                    GameState* state) {
+    batch->count++;
+
+    // The tag is the first byte in both protocols
+    CommandType type =
+        message->length > 0 ? (CommandType)(unsigned char)message->data[0]
+                            : (CommandType)0;
+    int kind = heldKind(type);
+    int player = kind < 0 ? -1 : peekPlayer(message, type);
+    if (player < 0) {
+        Command command;
+        if (!decodeMessage(message, &command)) {
+            return 1;
+        }
+        kind = heldKind(command.type);
+        if (kind < 0 && command.type == COMMAND_GAMESTATE) {
+            // The game state replaces everything before it, so what's held
+            // from before it is applied first, not over the top of it
+            int result = batchFinish(batch, state);
+            return applyCommand(&command, state) | result;
+        } else if (kind < 0) {
+            return applyCommand(&command, state);
+        }
+        // Decoding already checked that the player is 0 or 1
+        player = command.player;
+    }
+
+    // A damaged message replaces the one before it, and is caught when
+    // it's decoded
+    batch->held[player][kind] = *message;
+    batch->order[player][kind] = batch->count;
+    return 0;
+}
+
+// Get the next message for the game. Messages come from the client, and are
+// recorded if a replay is being recorded. When one is being played back,
+// they come from the replay instead.
+static bool nextMessage(Client* client, GameState* state,
+                        ClientMessage* message) {
+    Replay* replay = state->replay;
+    if (replay && replay->playing) {
+        return replayNextMessage(replay, client, message);
+    }
+
+    if (!clientNextMessage(client, message)) {
+        // The messages could have changed what the server accepted
+        if (replay) replayRecordClient(replay, client);
+        return false;
+    }
+    if (replay) replayRecordMessage(replay, message);
+    return true;
+}
+
+// Run every message waiting in the client's queue as one batch.
+// Alters GameState.
+int run_messages(Client* client, GameState* state) {
+    CommandBatch batch = {0};
+    int result = 0;
+
+    // Each message points straight into the client's queue, so nothing is
+    // allocated or copied.
+    ClientMessage message;
+    while (nextMessage(client, state, &message)) {
+        result |= batchAdd(&batch, &message, state);
+    }
+    result |= batchFinish(&batch, state);
+
+    // Give the space back to the client once every command has been applied
+    clientReleaseMessages(client);
+    return result;
+}
+
+// Run a single text command given over the network.
+// Alters GameState.
+int run_command(char* command, GameState* state) {
+    ClientMessage message = {command, strlen(command), PROTOCOL_TEXT};
+    return run_message(&message, state);
+}
+
+// Run commands given over the network, separated by \n, as one batch.
+// Alters GameState.
+int run_commands(char* commands, GameState* state) {
+    // Commands is a long string will all of the queued commands separated by
+    // \n. Each line is decoded where it is, so the string isn't modified.
+    char* end = commands + strlen(commands);
+    char* command = commands;
+    CommandBatch batch = {0};
+    int result = 0;
+
+    // While there are still commands
+    while (command < end) {
+        char* newline = memchr(command, '\n', end - command);
+        char* next = newline ? newline : end;
+
+        // Skip empty lines, like strtok did
+        if (next != command) {
+            ClientMessage message = {command, (int)(next - command),
+                                     PROTOCOL_TEXT};
+            if (batchAdd(&batch, &message, state)) {
+                result = 1;
+                break;
+            }
+        }
+
+        // Go to the next command.
+        command = next + 1;
+    }
+
+    // Whatever came before a bad command still gets applied
+    return batchFinish(&batch, state) | result;
+}
@@ -10,10 +10,6 @@
 // Includes
 #include "game.h"
 
-#include <allegro5/allegro.h>
-#include <allegro5/allegro_font.h>
-#include <allegro5/allegro_image.h>
-#include <allegro5/allegro_ttf.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,6 +17,10 @@
 
 #include "client.h"
 #include "commands.h"
+#include "protocol.h"
+#include "proximity.h"
+#include "replay.h"
+#include "serialize.h"
 
 // Utilities
 #define max(a, b) (((a) > (b)) ? (a) : (b))
@@ -31,6 +31,24 @@ const int speed = 600;
 const int trapRadius = 80;
 const int attackRadius = 100;
 
+// Position send policy defaults. Movement under half a pixel isn't sent, and
+// an idle player still sends its position once a second.
+const float positionEpsilon = 0.5f;
+const double positionHeartbeat = 1.0;
+
+// Logic ticks per second. Ticks are rounded to whole milliseconds (17ms),
+// the unit inputs are sent to the server in.
+const int tickRate = 60;
+// Longest frame simulated. After a longer stall the rest of the time is
+// dropped, since running ticks to catch up would only make the next frame
+// later.
+const double maxFrameTime = 0.25;
+
+// The other player is drawn 100ms in the past, which covers a few lost or
+// late position updates. If updates stop, they keep moving for 250ms.
+const double interpolationDelay = 0.1;
+const double maxExtrapolation = 0.25;
+
 // Allocate and initialize GameState
 GameState* gamestate_new(int player, int lobby) {
     if (player < 0 || player >= 2) {
@@ -42,12 +60,14 @@ GameState* gamestate_new(int player, int lobby) {
     memset(state, 0, sizeof(GameState));
     state->thisPlayer = player;
     state->lobby = lobby;
+    state->houseW = HOUSE_W;
+    state->houseH = HOUSE_H;
 
     // Read room data
     FILE* roomFile = fopen("room.txt", "r");
 
     // Variables used for sscanf
-    int furniture, room, food, exitRoom;
+    int furniture, room, food, exitRoom, houseW, houseH;
     // Line buffer
     char line[50];
     // Iterator in furniture array
@@ -55,20 +75,28 @@ GameState* gamestate_new(int player, int lobby) {
 
     // Get line from file
     while (fgets(line, 50, roomFile)) {
-        if (sscanf(line, "F %d %d %d", &furniture, &room, &food) == 3) {
+        if (sscanf(line, "F %d %d %d", &furniture, &room, &food) == 3 &&
+            furnitureI < FURNITURE_MAX) {
             // Furniture command
-            state->furniture[furnitureI].data = furniture;
-            state->furniture[furnitureI].room = room;
-            state->furniture[furnitureI].food = food;
+            state->furniture.data[furnitureI] = furniture;
+            state->furniture.room[furnitureI] = room;
+            state->furniture.food[furnitureI] = food;
             furnitureI++;
         } else if (sscanf(line, "E %d", &exitRoom) == 1) {
             // Exit room command
             state->exitRoom = exitRoom;
+        } else if (sscanf(line, "H %d %d", &houseW, &houseH) == 2 &&
+                   houseW > 0 && houseW <= HOUSE_MAX && houseH > 0 &&
+                   houseH <= HOUSE_MAX) {
+            // House size command
+            state->houseW = houseW;
+            state->houseH = houseH;
         }
     }
 
     // Close room file
     fclose(roomFile);
+    state->furniture.count = furnitureI;
     // Set all traps to true
     memset(state->trapInventory, true, sizeof(state->trapInventory));
 
@@ -84,10 +112,34 @@ GameState* gamestate_new(int player, int lobby) {
     state->furnitureAreas[2].pos.x = 1090;
     state->furnitureAreas[2].pos.y = 75;
     state->furnitureAreas[2].radius = 200;
+    indexFurniture(state);
+
+    // Position send policy. Send on the first frame.
+    state->positionPolicy.epsilon = positionEpsilon;
+    state->positionPolicy.heartbeat = positionHeartbeat;
+    state->positionPolicy.sinceLastSend = positionHeartbeat;
+
+    // The server doesn't know where the player starts. With prediction,
+    // send it before the first input.
+    state->teleported = true;
+
+    // Interpolation of the other player
+    state->interpolationDelay = interpolationDelay;
+    state->maxExtrapolation = maxExtrapolation;
+
+    setTickRate(state, tickRate);
 
     return state;
 }
 
+// Set how many times a second the game logic runs
+void setTickRate(GameState* state, int ticksPerSecond) {
+    // Inputs are sent with their length in whole milliseconds (up to 255),
+    // so ticks are too. The server then moves the player exactly as far.
+    int milliseconds = (int)lround(1000.0 / max(ticksPerSecond, 1));
+    state->tickLength = min(max(milliseconds, 1), 255) / 1000.0;
+}
+
 // On player death. Reset position, give inventory.
 void onDeath(Client* client, GameState* state, Player* player, Player* other) {
     // Reset position and health
@@ -96,6 +148,12 @@ void onDeath(Client* client, GameState* state, Player* player, Player* other) {
     player->pos.y = SCREEN_H / 2.0f;
     player->roomChanged = true;
     player->health = 100.0f;
+    // Don't draw the player sliding back to the start
+    player->previousPos = player->pos;
+
+    // Inputs sent before this no longer apply
+    predictionTeleport(&state->prediction);
+    state->teleported = true;
 
     // Give inventory to other player
     for (int i = 0; i < FOOD_COUNT; i++) {
@@ -112,29 +170,43 @@ void onDeath(Client* client, GameState* state, Player* player, Player* other) {
     memset(player->foodInventory, false, sizeof(player->foodInventory));
 }
 
-// Run game logic. Runs every frame.
+// Run the game logic for the time a frame took, in fixed ticks. The time
+// left over is carried to the next frame, and the players are drawn that
+// far between the last two ticks.
+void runFrame(Client* client, GameState* gameState, Player* player,
+              Player* other, MoveInput* input, double frameTime) {
+    gameState->accumulator += min(frameTime, maxFrameTime);
+    while (gameState->accumulator >= gameState->tickLength &&
+           !gameState->done) {
+        // Keep where the players were, to draw between the two ticks
+        for (int i = 0; i < 2; i++) {
+            gameState->players[i].previousPos = gameState->players[i].pos;
+            gameState->players[i].previousRoom = gameState->players[i].room;
+        }
+
+        runGameLogic(client, gameState, player, other, moveInputTake(input),
+                     gameState->tickLength);
+        gameState->accumulator -= gameState->tickLength;
+    }
+}
+
+// Run one tick of game logic.
 void runGameLogic(Client* client, GameState* gameState, Player* player,
-                  Player* other, unsigned char key[ALLEGRO_KEY_MAX],
-                  double dt) {
+                  Player* other, int input, double dt) {
+    gameState->clock += dt;
+    gameState->tick++;
+    if (gameState->replay) {
+        replayRecordTick(gameState->replay, client, input);
+    }
+
     // Face towards heading direction.
     int oldFacing = player->facing;
     // Movement
-    if (key[ALLEGRO_KEY_W]) {
-        player->pos.y -= min(speed * dt, player->pos.y);
-        player->facing = 0;
-    }
-    if (key[ALLEGRO_KEY_A]) {
-        player->pos.x -= min(speed * dt, player->pos.x);
-        player->facing = 1;
-    }
-    if (key[ALLEGRO_KEY_S]) {
-        player->pos.y += min(speed * dt, SCREEN_H - player->pos.y);
-        player->facing = 2;
-    }
-    if (key[ALLEGRO_KEY_D]) {
-        player->pos.x += min(speed * dt, SCREEN_W - player->pos.x);
-        player->facing = 3;
-    }
+    bool predicting = client->acceptedFeatures & FEATURE_PREDICTION;
+    // With prediction the server moves the player by whole milliseconds, so
+    // do the same here or the prediction would drift.
+    int duration = min((int)lround(dt * 1000.0), 255);
+    movePlayer(player, input, predicting ? duration / 1000.0 : dt);
 
     // update facing if it has changed.
     if (oldFacing != player->facing) {
@@ -145,69 +217,67 @@ void runGameLogic(Client* client, GameState* gameState, Player* player,
     int door = checkDoors(player);
     // Returns 0 if no doors
     if (door) {
-        if (door == 1) {
-            // Left door
-            if (player->room % HOUSE_W != 0) {
-                player->room -= 1;
-                player->pos.x = SCREEN_W - 5;
-            }
-        } else if (door == 2) {
-            // Right door
-            if (player->room % HOUSE_W != HOUSE_W - 1) {
-                player->room += 1;
-                player->pos.x = 5;
-            }
-        } else if (door == 3) {
-            // Up door
-            // Check if the exit was unlocked and the player is in the right
-            // room
-            if (gameState->exitUnlocked &&
-                player->room == gameState->exitRoom) {
-                updateGameOver(client, gameState);
-            } else if (player->room - HOUSE_W >= 0) {
-                player->room -= HOUSE_W;
-                player->pos.y = SCREEN_H - 5;
-            }
-        } else if (door == 4) {
-            // Down door
-            if (player->room + HOUSE_W < ROOM_MAX) {
-                player->room += HOUSE_W;
-                player->pos.y = 5;
-            }
+        // Check if the exit was unlocked and the player is in the right
+        // room
+        if (door == 3 && gameState->exitUnlocked &&
+            player->room == gameState->exitRoom) {
+            updateGameOver(client, gameState);
+        } else {
+            walkThroughDoor(gameState, player, door);
         }
         // Send a room update
         player->roomChanged = true;
     }
 
-    // Check if player is making contact with trap
-    for (int i = 0; i < TRAP_MAX; i++) {
-        // Check for a trap
-        // Check if the owner is the player
-        // Check if the trap is in the same room as the player
+    // Send this tick's input along with where it left the player. Idle
+    // ticks don't move the player, so they aren't sent.
+    if (predicting && input) {
+        updateInput(client, gameState, input, duration);
+    }
+
+    // Check if player is making contact with trap. Only the traps in grid
+    // cells near the player can be close enough, and their distances are
+    // all checked at once.
+    int nearby[TRAP_MAX];
+    float nearbyX[TRAP_MAX];
+    float nearbyY[TRAP_MAX];
+    uint32_t hits[PROXIMITY_WORDS(TRAP_MAX)];
+    int nearbyCount =
+        trapGridQuery(&gameState->traps.grid, player->room, player->pos.x,
+                      player->pos.y, trapRadius, nearby, TRAP_MAX);
+    for (int n = 0; n < nearbyCount; n++) {
+        nearbyX[n] = gameState->traps.x[nearby[n]];
+        nearbyY[n] = gameState->traps.y[nearby[n]];
+    }
+    int hitCount = proximityQuery(nearbyX, nearbyY, nearbyCount,
+                                  player->pos.x, player->pos.y, trapRadius,
+                                  hits);
+    for (int n = 0; n < nearbyCount && hitCount > 0; n++) {
         // Check if the player is in the trap radius
-        if (gameState->traps[i].data != TRAP_NONE &&
-            gameState->traps[i].owner != gameState->thisPlayer &&
-            gameState->traps[i].room == player->room &&
-            euclidDistance(gameState->traps[i].pos, player->pos) <=
-                trapRadius) {
+        if (!proximityHit(hits, n)) continue;
+        hitCount--;
+
+        int trap = nearby[n];
+        // Check if the owner is the player
+        // Check if the trap is in the same room as the player (it might not
+        // be after dying to another trap)
+        if (trapOwner(gameState, trap) != gameState->thisPlayer &&
+            trapRoom(gameState, trap) == player->room) {
             // Call death function
             onDeath(client, gameState, player, other);
             // Remove trap from game
-            updateTrapActivated(client, gameState, i);
+            updateTrapActivated(client, gameState, trapId(gameState, trap));
         }
     }
 
-    // Mark all keys as seen.
-    for (int i = 0; i < ALLEGRO_KEY_MAX; i++) {
-        key[i] &= KEY_SEEN;
-    }
+    // Recieve commands from network. Superseded positions are skipped, so
+    // catching up after a stall doesn't apply every one of them.
+    run_messages(client, gameState);
 
-    // Recieve commands from network
-    char* commands = clientRecvAll(client);
-    // Run commands
-    if (commands) {
-        run_commands(commands, gameState);
-        free(commands);
+    // A player is joining, and needs to know what's happened so far
+    if (gameState->gameStateRequested) {
+        updateGameState(client, gameState);
+        gameState->gameStateRequested = false;
     }
 
     // Check if player has been killed
@@ -215,56 +285,217 @@ void runGameLogic(Client* client, GameState* gameState, Player* player,
         onDeath(client, gameState, player, other);
     }
 
-    // Update position and room
-    updatePosition(client, gameState);
+    // Update position and room. The position is only sent if it changed,
+    // or if it's time for a heartbeat. A room change always sends it, since
+    // the player was moved to the other side of the door.
+    // With prediction the server moves the player itself, and only needs
+    // to be told when the player is teleported.
+    if (predicting) {
+        if (gameState->teleported) {
+            updatePosition(client, gameState);
+            gameState->teleported = false;
+        }
+    } else if (shouldSendPosition(&gameState->positionPolicy, player->pos,
+                                  player->roomChanged, dt)) {
+        updatePosition(client, gameState);
+
+        // Facing goes over UDP when the side channel is active, and a lost
+        // one wouldn't be sent again until the player turns. Repeat it with
+        // every heartbeat.
+        if (client->udpActive && gameState->positionPolicy.heartbeatSent) {
+            updateFacing(client, gameState);
+        }
+    }
     if (player->roomChanged) {
         updateRoom(client, gameState);
         player->roomChanged = false;
     };
+
+    // Send everything queued this frame (including messages from key
+    // presses since the last frame) in one write.
+    clientFlush(client);
+
+    if (gameState->replay) {
+        replayRecordDigest(gameState->replay, gameState);
+    }
 }
 
-// Logic for when the player presses a key.
-void onKeyDown(Client* client, GameState* gameState, ALLEGRO_EVENT event,
-               Player* player, Player* other) {
-    if (event.keyboard.keycode >= ALLEGRO_KEY_1 &&
-        event.keyboard.keycode <= ALLEGRO_KEY_3 &&
-        gameState->trapInventory[event.keyboard.keycode - ALLEGRO_KEY_1]) {
+// Logic for when the player presses a key, after it was turned into an
+// action.
+void onAction(Client* client, GameState* gameState, Action action,
+              Player* player, Player* other) {
+    if (gameState->replay) {
+        replayRecordAction(gameState->replay, action);
+    }
+
+    if (action >= ACTION_TRAP_CHEESE && action <= ACTION_TRAP_BOMB &&
+        gameState->trapInventory[action - ACTION_TRAP_CHEESE]) {
         // Set a trap
-        updateTrap(client, gameState,
-                   event.keyboard.keycode - ALLEGRO_KEY_1 + 1);
-        gameState->trapInventory[event.keyboard.keycode - ALLEGRO_KEY_1] =
-            false;
-    } else if (event.keyboard.keycode == ALLEGRO_KEY_SPACE) {
+        updateTrap(client, gameState, (TrapData)action);
+        gameState->trapInventory[action - ACTION_TRAP_CHEESE] = false;
+    } else if (action == ACTION_SEARCH) {
         // Search for food
-        float lowestDistance = 1000000.0f;
+        float lowestDistance = INFINITY;
         int closestFurniture = -1;
 
-        // Find closest furniture item
-        for (int i = 0; i < FURNITURE_MAX; i++) {
-            if (gameState->furniture[i].data == FURNITURE_NONE) continue;
-
-            Area area =
-                gameState->furnitureAreas[gameState->furniture[i].data - 1];
-            float distance = euclidDistance(area.pos, player->pos);
-
-            if (gameState->furniture[i].room == player->room &&
-                distance <= area.radius && distance < lowestDistance) {
-                lowestDistance = distance;
-                closestFurniture = i;
+        // Find closest furniture item in the player's room. If none of it
+        // has food, there's nothing to find.
+        const FurnitureTable* furniture = &gameState->furniture;
+        int room = findFurnitureRoom(furniture, player->room);
+        if (room >= 0 && furniture->roomFood[room] > 0) {
+            // Check every piece's search area at once, then find the
+            // closest of the ones in reach
+            int start = furniture->roomStart[room];
+            int count = furniture->roomStart[room + 1] - start;
+            float areaX[FURNITURE_MAX];
+            float areaY[FURNITURE_MAX];
+            float areaRadius[FURNITURE_MAX];
+            uint32_t hits[PROXIMITY_WORDS(FURNITURE_MAX)];
+            for (int n = 0; n < count; n++) {
+                int i = furniture->roomFurniture[start + n];
+                Area area = furniture->area[i];
+                areaX[n] = area.pos.x;
+                areaY[n] = area.pos.y;
+                areaRadius[n] = area.radius;
+            }
+            int hitCount =
+                proximityQueryEach(areaX, areaY, areaRadius, count,
+                                   player->pos.x, player->pos.y, hits);
+            for (int n = 0; n < count && hitCount > 0; n++) {
+                if (!proximityHit(hits, n)) continue;
+                hitCount--;
+
+                int i = furniture->roomFurniture[start + n];
+                float distance =
+                    distanceSquared(furniture->area[i].pos, player->pos);
+                if (distance < lowestDistance) {
+                    lowestDistance = distance;
+                    closestFurniture = i;
+                }
             }
         }
 
         // Check if it has food
         if (closestFurniture != -1 &&
-            gameState->furniture[closestFurniture].food != FOOD_NONE) {
+            furnitureFood(gameState, closestFurniture) != FOOD_NONE) {
             // Take the food
             updateItemTaken(client, gameState, closestFurniture);
         }
-    } else if (event.keyboard.keycode == ALLEGRO_KEY_P &&
+    } else if (action == ACTION_ATTACK &&
                player->room == other->room &&
-               euclidDistance(player->pos, other->pos) < attackRadius) {
+               distanceSquared(player->pos, other->pos) <
+                   attackRadius * attackRadius) {
         // Attack player
         updateAttack(client, gameState, 20.0);
+    } else if (action == ACTION_TOGGLE_STATS) {
+        // Toggle the network overlay
+        gameState->showNetStats = !gameState->showNetStats;
+    }
+}
+
+// Move a player for one tick, facing the last direction moved in. The
+// server does the same for predicted players (see move_player in
+// server.py), so the two have to be changed together.
+void movePlayer(Player* player, int input, double dt) {
+    if (input & INPUT_UP) {
+        player->pos.y -= min(speed * dt, player->pos.y);
+        player->facing = 0;
+    }
+    if (input & INPUT_LEFT) {
+        player->pos.x -= min(speed * dt, player->pos.x);
+        player->facing = 1;
+    }
+    if (input & INPUT_DOWN) {
+        player->pos.y += min(speed * dt, SCREEN_H - player->pos.y);
+        player->facing = 2;
+    }
+    if (input & INPUT_RIGHT) {
+        player->pos.x += min(speed * dt, SCREEN_W - player->pos.x);
+        player->facing = 3;
+    }
+}
+
+// Room on the other side of a door (from checkDoors), or -1 if that side of
+// the room is an outside wall
+int roomThroughDoor(const GameState* state, int room, int door) {
+    int column = room % state->houseW;
+    if (door == 1) {
+        // Left door
+        return column != 0 ? room - 1 : -1;
+    } else if (door == 2) {
+        // Right door
+        return column != state->houseW - 1 ? room + 1 : -1;
+    } else if (door == 3) {
+        // Up door
+        return room - state->houseW >= 0 ? room - state->houseW : -1;
+    } else if (door == 4) {
+        // Down door
+        return room + state->houseW < houseRooms(state) ? room + state->houseW
+                                                        : -1;
+    }
+    return -1;
+}
+
+// Move a player through a door (from checkDoors) into the next room, if
+// there is one on that side
+void walkThroughDoor(const GameState* state, Player* player, int door) {
+    int room = roomThroughDoor(state, player->room, door);
+    if (room < 0) {
+        return;
+    }
+
+    player->room = room;
+    if (door == 1) {
+        player->pos.x = SCREEN_W - 5;
+    } else if (door == 2) {
+        player->pos.x = 5;
+    } else if (door == 3) {
+        player->pos.y = SCREEN_H - 5;
+    } else {
+        player->pos.y = 5;
+    }
+}
+
+// Check the server's position after one of our inputs against the
+// prediction. If they differ, start from the server's position and replay
+// the inputs it hasn't applied yet.
+void reconcilePrediction(GameState* state, const Command* command) {
+    Prediction* prediction = &state->prediction;
+    Player* player = &state->players[state->thisPlayer];
+
+    InputTick acknowledged;
+    int found =
+        predictionAcknowledge(prediction, command->sequence, &acknowledged);
+    if (found < 0) {
+        return;
+    }
+
+    // Positions sent over the binary protocol are rounded
+    float tolerance = 1.0f / POSITION_SCALE;
+    if (found && acknowledged.room == command->room &&
+        fabsf(acknowledged.x - command->x) <= tolerance &&
+        fabsf(acknowledged.y - command->y) <= tolerance) {
+        return;
+    }
+
+    prediction->corrections++;
+    int oldRoom = player->room;
+    player->pos.x = command->x;
+    player->pos.y = command->y;
+    player->room = command->room;
+
+    for (int i = 0; i < prediction->count; i++) {
+        InputTick* tick = predictionPending(prediction, i);
+        movePlayer(player, tick->input, tick->duration / 1000.0);
+        walkThroughDoor(state, player, checkDoors(player));
+        tick->x = player->pos.x;
+        tick->y = player->pos.y;
+        tick->room = player->room;
+    }
+
+    // Tell the other player if the correction moved us to another room
+    if (player->room != oldRoom) {
+        player->roomChanged = true;
     }
 }
 
@@ -283,170 +514,260 @@ int checkDoors(Player* player) {
     return 0;
 }
 
-// Calculate distance between two points
-float euclidDistance(Position p1, Position p2) {
-    return sqrtf(powf(p1.x - p2.x, 2.0f) + powf(p1.y - p2.y, 2.0f));
+// Round a coordinate to the precision of the binary protocol
+static float quantize(float value) {
+    return roundf(value * POSITION_SCALE) / POSITION_SCALE;
+}
+
+// Decide whether a position update should be sent this frame, and count
+// the sends and skipped sends.
+bool shouldSendPosition(PositionPolicy* policy, Position pos, bool force,
+                        double dt) {
+    policy->sinceLastSend += dt;
+
+    // Compare what the server would actually recieve
+    Position quantized = {quantize(pos.x), quantize(pos.y)};
+    bool moved = fabsf(quantized.x - policy->lastSent.x) > policy->epsilon ||
+                 fabsf(quantized.y - policy->lastSent.y) > policy->epsilon;
+
+    if (!force && !moved && policy->sinceLastSend < policy->heartbeat) {
+        policy->suppressed++;
+        return false;
+    }
+
+    // Remember if this send is only because of the heartbeat
+    policy->heartbeatSent = !force && !moved;
+    policy->lastSent = quantized;
+    policy->sinceLastSend = 0.0;
+    policy->sent++;
+    return true;
+}
+
+// Check that a piece of furniture is a real type, in a real room
+static bool furnitureInHouse(const GameState* state, int i) {
+    const FurnitureTable* furniture = &state->furniture;
+    return roomInHouse(state, furniture->room[i]) &&
+           furniture->data[i] > FURNITURE_NONE &&
+           furniture->data[i] <= FURNITURE_COUNT;
+}
+
+// Sort the furniture into rooms, and look up where each piece can be
+// searched from
+void indexFurniture(GameState* state) {
+    FurnitureTable* furniture = &state->furniture;
+
+    // List the furniture in the house by room. The insertion sort keeps
+    // slots in order within a room, so furniture is still layered the way
+    // the room file lists it.
+    int listed = 0;
+    for (int i = 0; i < furniture->count; i++) {
+        if (!furnitureInHouse(state, i)) {
+            furniture->food[i] = FOOD_NONE;
+            continue;
+        }
+        furniture->area[i] = state->furnitureAreas[furniture->data[i] - 1];
+        int k = listed++;
+        while (k > 0 && furniture->room[furniture->roomFurniture[k - 1]] >
+                            furniture->room[i]) {
+            furniture->roomFurniture[k] = furniture->roomFurniture[k - 1];
+            k--;
+        }
+        furniture->roomFurniture[k] = i;
+    }
+
+    // Then split the list where the room changes
+    furniture->roomCount = 0;
+    for (int k = 0; k < listed; k++) {
+        int i = furniture->roomFurniture[k];
+        int r = furniture->roomCount - 1;
+        if (r < 0 || furniture->rooms[r] != furniture->room[i]) {
+            r = furniture->roomCount++;
+            furniture->rooms[r] = furniture->room[i];
+            furniture->roomStart[r] = k;
+            furniture->roomFood[r] = 0;
+        }
+        if (furniture->food[i] != FOOD_NONE) furniture->roomFood[r]++;
+    }
+    furniture->roomStart[furniture->roomCount] = listed;
+}
+
+// Find a room in the furniture index. Rooms are sorted, so it's a binary
+// search.
+int findFurnitureRoom(const FurnitureTable* furniture, int room) {
+    int low = 0;
+    int high = furniture->roomCount;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (furniture->rooms[middle] < room) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < furniture->roomCount && furniture->rooms[low] == room ? low
+                                                                        : -1;
 }
 
-// Send a lobby update
+// Take the food out of a piece of furniture. Furniture with food is always
+// in the index.
+void emptyFurniture(GameState* state, int furniture) {
+    FurnitureTable* table = &state->furniture;
+    if (table->food[furniture] == FOOD_NONE) return;
+    table->food[furniture] = FOOD_NONE;
+    table->roomFood[findFurnitureRoom(table, table->room[furniture])]--;
+}
+
+// Calculate the squared distance between two points. Compare it against a
+// squared radius, so there's no square root.
+float distanceSquared(Position p1, Position p2) {
+    float dx = p1.x - p2.x;
+    float dy = p1.y - p2.y;
+    return dx * dx + dy * dy;
+}
+
+// Send a lobby update. Also asks the server for the newest protocol and
+// the features we support; the client switches once the server answers.
 void updateLobby(Client* client, GameState* state) {
-    char command[50];
-    snprintf(command, 50, "J,%d\n", state->lobby);
-    clientSendAll(client, command, strlen(command));
+    Command command = {.type = COMMAND_JOIN,
+                       .lobby = state->lobby,
+                       .version = PROTOCOL_VERSION,
+                       .features = client->features};
+    clientSendCommand(client, state->lobby, &command);
 }
 
 // Send a position update
 void updatePosition(Client* client, GameState* state) {
-    char command[50];
-    snprintf(command, 50, "%d,P,%d,%.2f,%.2f\n", state->lobby,
-             state->thisPlayer, state->players[state->thisPlayer].pos.x,
-             state->players[state->thisPlayer].pos.y);
-    clientSendAll(client, command, strlen(command));
+    Command command = {.type = COMMAND_POSITION,
+                       .player = state->thisPlayer,
+                       .x = state->players[state->thisPlayer].pos.x,
+                       .y = state->players[state->thisPlayer].pos.y};
+    clientSendCommand(client, state->lobby, &command);
 }
 
 // Send a room update
 void updateRoom(Client* client, GameState* state) {
-    char command[50];
-    snprintf(command, 50, "%d,R,%d,%d\n", state->lobby, state->thisPlayer,
-             state->players[state->thisPlayer].room);
-    clientSendAll(client, command, strlen(command));
+    Command command = {.type = COMMAND_ROOM,
+                       .player = state->thisPlayer,
+                       .room = state->players[state->thisPlayer].room};
+    clientSendCommand(client, state->lobby, &command);
 }
 
 // Place a trap
 void updateTrap(Client* client, GameState* state, TrapData trap) {
-    char command[50];
-    snprintf(command, 50, "%d,T,%d,%d,%d,%.2f,%.2f\n", state->lobby,
-             state->thisPlayer, (int)trap,
-             state->players[state->thisPlayer].room,
-             state->players[state->thisPlayer].pos.x,
-             state->players[state->thisPlayer].pos.y);
-    clientSendAll(client, command, strlen(command));
+    Command command = {.type = COMMAND_TRAP,
+                       .player = state->thisPlayer,
+                       .trapData = (int)trap,
+                       .room = state->players[state->thisPlayer].room,
+                       .x = state->players[state->thisPlayer].pos.x,
+                       .y = state->players[state->thisPlayer].pos.y};
+    clientSendCommand(client, state->lobby, &command);
 }
 
 // Attack player
 void updateAttack(Client* client, GameState* state, float damage) {
-    char command[50];
-    snprintf(command, 50, "%d,C,%d,%.2f\n", state->lobby, !state->thisPlayer,
-             damage);
-    clientSendAll(client, command, strlen(command));
+    Command command = {.type = COMMAND_ATTACK,
+                       .player = !state->thisPlayer,
+                       .damage = damage};
+    clientSendCommand(client, state->lobby, &command);
 }
 
 // Game over
 void updateGameOver(Client* client, GameState* state) {
-    char command[50];
-    snprintf(command, 50, "%d,O,%d\n", state->lobby, state->thisPlayer);
-    clientSendAll(client, command, strlen(command));
+    Command command = {.type = COMMAND_GAMEOVER, .player = state->thisPlayer};
+    clientSendCommand(client, state->lobby, &command);
+}
+
+// Send the game state, for a player joining
+void updateGameState(Client* client, GameState* state) {
+    char gameState[GAMESTATE_MAX];
+    int length = serializeGameState(state, gameState, sizeof(gameState));
+    Command command = {.type = COMMAND_GAMESTATE,
+                       .gameState = {gameState, length}};
+    clientSendCommand(client, state->lobby, &command);
 }
 
 // Take item from furniture
 void updateItemTaken(Client* client, GameState* state, int furnitureN) {
-    char command[50];
-    snprintf(command, 50, "%d,I,%d,%d,%d\n", state->lobby, state->thisPlayer,
-             furnitureN, state->furniture[furnitureN].food);
-    clientSendAll(client, command, strlen(command));
+    Command command = {.type = COMMAND_ITEM,
+                       .player = state->thisPlayer,
+                       .furniture = furnitureN,
+                       .item = furnitureFood(state, furnitureN)};
+    clientSendCommand(client, state->lobby, &command);
 }
 
 // Take item from player
 void updateItemTakenOnDeath(Client* client, GameState* state, int item) {
-    char command[50];
     // Furniture as -1 to signify source as player
-    snprintf(command, 50, "%d,I,%d,%d,%d\n", state->lobby, !state->thisPlayer,
-             -1, item);
-    clientSendAll(client, command, strlen(command));
+    Command command = {.type = COMMAND_ITEM,
+                       .player = !state->thisPlayer,
+                       .furniture = -1,
+                       .item = item};
+    clientSendCommand(client, state->lobby, &command);
 }
 
 // Player stepped on a trap
 void updateTrapActivated(Client* client, GameState* state, int trapN) {
-    char command[50];
-    snprintf(command, 50, "%d,A,%d\n", state->lobby, trapN);
-    clientSendAll(client, command, strlen(command));
+    Command command = {.type = COMMAND_TRAPACTIVATED, .trap = trapN};
+    clientSendCommand(client, state->lobby, &command);
+}
+
+// Send one tick of movement input, and remember where it left the player
+void updateInput(Client* client, GameState* state, int input, int duration) {
+    Player* player = &state->players[state->thisPlayer];
+    InputTick* tick = predictionRecord(&state->prediction, input, duration);
+    tick->x = player->pos.x;
+    tick->y = player->pos.y;
+    tick->room = player->room;
+
+    Command command = {.type = COMMAND_INPUT,
+                       .player = state->thisPlayer,
+                       .sequence = tick->sequence,
+                       .input = input,
+                       .duration = duration};
+    clientSendCommand(client, state->lobby, &command);
 }
 
 // Player is facing other direction
 void updateFacing(Client* client, GameState* state) {
-    char command[50];
-    snprintf(command, 50, "%d,F,%d,%d\n", state->lobby, state->thisPlayer,
-             state->players[state->thisPlayer].facing);
-    clientSendAll(client, command, strlen(command));
+    Command command = {.type = COMMAND_FACING,
+                       .player = state->thisPlayer,
+                       .facing = state->players[state->thisPlayer].facing};
+    clientSendCommand(client, state->lobby, &command);
 }
 
-// Load bitmap and quit on error
-ALLEGRO_BITMAP* loadBitmap(const char* path) {
-    ALLEGRO_BITMAP* bitmap = al_load_bitmap(path);
-    if (!bitmap) {
-        fprintf(stderr, "Failed to load bitmap: %s\n", path);
-        exit(1);
-    }
-    return bitmap;
-}
+// Set where each player is drawn. This player is drawn between its last
+// two ticks. The other player is drawn between the positions recieved from
+// the server.
+void interpolatePlayers(GameState* state) {
+    // How far the frame is past the last tick
+    float alpha = (float)(state->accumulator / state->tickLength);
+
+    for (int i = 0; i < 2; i++) {
+        Player* player = &state->players[i];
+        if (i == state->thisPlayer) {
+            // Going through a door moves the player across the screen
+            if (player->room != player->previousRoom) {
+                player->renderPos = player->pos;
+            } else {
+                player->renderPos.x =
+                    player->previousPos.x +
+                    (player->pos.x - player->previousPos.x) * alpha;
+                player->renderPos.y =
+                    player->previousPos.y +
+                    (player->pos.y - player->previousPos.y) * alpha;
+            }
+            continue;
+        }
 
-// Load font and quit on error
-ALLEGRO_FONT* loadFont(const char* path, int size, int flags) {
-    ALLEGRO_FONT* font = al_load_ttf_font(path, size, flags);
-    if (!font) {
-        fprintf(stderr, "Failed to load font: %s\n", path);
-        exit(1);
+        float x, y;
+        if (!snapshotSample(&player->snapshots,
+                            state->clock + state->accumulator,
+                            state->interpolationDelay,
+                            state->maxExtrapolation, &x, &y)) {
+            player->renderPos = player->pos;
+            continue;
+        }
+        player->renderPos.x = x;
+        player->renderPos.y = y;
     }
-    return font;
 }
-
-// Load all assets
-void loadAssets(Assets* assets) {
-    // Trap and food enums start at one
-    assets->trapBitmaps[TRAP_CHEESE - 1] = loadBitmap("assets/cheeseTrap.png");
-    assets->trapBitmaps[TRAP_ACID - 1] = loadBitmap("assets/acidTrap.png");
-    assets->trapBitmaps[TRAP_BOMB - 1] = loadBitmap("assets/bombTrap.png");
-
-    assets->foodBitmaps[FOOD_BANANA - 1] = loadBitmap("assets/bananaFood.png");
-    assets->foodBitmaps[FOOD_CEREAL - 1] = loadBitmap("assets/cerealFood.png");
-    assets->foodBitmaps[FOOD_STRAWBERRY - 1] =
-        loadBitmap("assets/strawberryFood.png");
-    assets->foodBitmaps[FOOD_PEANUT - 1] = loadBitmap("assets/peanutFood.png");
-    assets->foodBitmaps[FOOD_PIZZA - 1] = loadBitmap("assets/pizzaFood.png");
-
-    // Player 1 images
-    assets->graySquirrelBitmaps[0] =
-        loadBitmap("assets/squirrelGrayForward.png");
-    assets->graySquirrelBitmaps[1] = loadBitmap("assets/squirrelGrayLeft.png");
-    assets->graySquirrelBitmaps[2] =
-        loadBitmap("assets/squirrelGrayBackward.png");
-    assets->graySquirrelBitmaps[3] = loadBitmap("assets/squirrelGrayRight.png");
-
-    // Arrows to move between rooms
-    assets->arrowBitmaps[0] = loadBitmap("assets/upArrow.png");
-    assets->arrowBitmaps[1] = loadBitmap("assets/leftArrow.png");
-    assets->arrowBitmaps[2] = loadBitmap("assets/downArrow.png");
-    assets->arrowBitmaps[3] = loadBitmap("assets/rightArrow.png");
-
-    // Player 2 images
-    assets->brownSquirrelBitmaps[0] =
-        loadBitmap("assets/squirrelBrownForward.png");
-    assets->brownSquirrelBitmaps[1] =
-        loadBitmap("assets/squirrelBrownLeft.png");
-    assets->brownSquirrelBitmaps[2] =
-        loadBitmap("assets/squirrelBrownBackward.png");
-    assets->brownSquirrelBitmaps[3] =
-        loadBitmap("assets/squirrelBrownRight.png");
-
-    // Furniture
-    assets->furnitureBitmaps[0] = loadBitmap("assets/cabinetFurniture.png");
-    assets->furnitureBitmaps[1] = loadBitmap("assets/carpetFurniture.png");
-    assets->furnitureBitmaps[2] = loadBitmap("assets/bookshelfFurniture.png");
-
-    // UI stuff
-    assets->grayIcon = loadBitmap("assets/grayIcon.png");
-    assets->brownIcon = loadBitmap("assets/brownIcon.png");
-    assets->slotIcon = loadBitmap("assets/slotIcon.png");
-    assets->minimapIcon = loadBitmap("assets/minimapIcon.png");
-    assets->background = loadBitmap("assets/background.png");
-    assets->foodInventoryIcon = loadBitmap("assets/foodInventoryIcon.png");
-    assets->healthBar = loadBitmap("assets/healthBar.png");
-    assets->exit = loadBitmap("assets/exit.png");
-    assets->menu = loadBitmap("assets/menu.png");
-    assets->helpScreens[0] = loadBitmap("assets/Help1.png");
-    assets->helpScreens[1] = loadBitmap("assets/Help2.png");
-    assets->helpScreens[2] = loadBitmap("assets/Help3.png");
-
-    // essential image
-    loadBitmap("assets/flamingo.jpg");
-}
\ No newline at end of file
@@ -14,14 +14,18 @@
 #include <allegro5/allegro_primitives.h>
 #include <allegro5/allegro_ttf.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 
-#include "game.h"
+#include "graphics.h"
 
 // Graphics constants
 const int offset = 50;
 const int outlineOffset = 25;
 
+// Minimap cells for a house of the default size. Other houses are scaled to
+// fit the same area.
 const int minimapOffsetX = 97;
 const int minimapOffsetY = 80;
 const int minimapCellSizeX = 128;
@@ -60,7 +64,7 @@ void drawPlayers(GameState* gameState, Player* player, Assets* assets) {
         // Check if the player in in the same room as the current player
         if (p->room == player->room) {
             // Apply perspective
-            Position coords = toScreenCoords(p->pos);
+            Position coords = toScreenCoords(p->renderPos);
 
             // Draw player
             if (i == 0) {
@@ -104,29 +108,35 @@ void drawMinimap(GameState* gameState, Assets* assets) {
                           al_get_bitmap_height(assets->minimapIcon), 25, 25,
                           4 * cellSize, 2 * cellSize, 0);
 
+    // Size of a room on the minimap, and where the first one's centre is
+    float cellX = (float)minimapCellSizeX * HOUSE_W / gameState->houseW;
+    float cellY = (float)minimapCellSizeY * HOUSE_H / gameState->houseH;
+    float firstX = minimapOffsetX + (cellX - minimapCellSizeX) / 2;
+    float firstY = minimapOffsetY + (cellY - minimapCellSizeY) / 2;
+
     // Draw player dots
     for (int i = 0; i < 2; i++) {
         Player* p = &gameState->players[i];
         // Get x and y coordinates of dot
-        int room_x = p->room % HOUSE_W;
-        int room_y = p->room / HOUSE_W;
+        int room_x = p->room % gameState->houseW;
+        int room_y = p->room / gameState->houseW;
         // Draw bitmaps
         if (i == 0) {
             al_draw_scaled_bitmap(assets->grayIcon, 0, 0,
                                   al_get_bitmap_width(assets->grayIcon),
                                   al_get_bitmap_height(assets->grayIcon),
-                                  room_x * minimapCellSizeX + minimapOffsetX -
+                                  room_x * cellX + firstX -
                                       squirrelIconSize / 2,
-                                  room_y * minimapCellSizeY + minimapOffsetY -
+                                  room_y * cellY + firstY -
                                       squirrelIconSize / 2,
                                   squirrelIconSize, squirrelIconSize, 0);
         } else {
             al_draw_scaled_bitmap(assets->brownIcon, 0, 0,
                                   al_get_bitmap_width(assets->grayIcon),
                                   al_get_bitmap_height(assets->grayIcon),
-                                  room_x * minimapCellSizeX + minimapOffsetX -
+                                  room_x * cellX + firstX -
                                       squirrelIconSize / 2,
-                                  room_y * minimapCellSizeY + minimapOffsetY -
+                                  room_y * cellY + firstY -
                                       squirrelIconSize / 2,
                                   squirrelIconSize, squirrelIconSize, 0);
         }
@@ -184,27 +194,23 @@ void drawFoodInventory(GameState* gameState, Player* player, Assets* assets) {
 
 // Draw traps on room
 void drawTraps(GameState* gameState, Player* player, Assets* assets) {
-    // Iterate all traps
-    for (int i = 0; i < TRAP_MAX; i++) {
-        // Check type & room
-        if (gameState->traps[i].data != TRAP_NONE &&
-            gameState->traps[i].room == player->room) {
-            // Apply perspective
-            Position coords = toScreenCoords(gameState->traps[i].pos);
-
-            // Draw trap
-            al_draw_scaled_bitmap(
-                assets->trapBitmaps[gameState->traps[i].data - 1], 0, 0,
-                al_get_bitmap_width(
-                    assets->trapBitmaps[gameState->traps[i].data - 1]),
-                al_get_bitmap_height(
-                    assets->trapBitmaps[gameState->traps[i].data - 1]),
+    // Iterate the traps in the player's room
+    for (int i = trapGridRoomFirst(&gameState->traps.grid, player->room);
+         i >= 0; i = trapGridRoomNext(&gameState->traps.grid, i)) {
+        // Apply perspective
+        Position coords = toScreenCoords(trapPos(gameState, i));
+        ALLEGRO_BITMAP* bitmap =
+            assets->trapBitmaps[trapData(gameState, i) - 1];
+
+        // Draw trap
+        al_draw_scaled_bitmap(
+            bitmap, 0, 0, al_get_bitmap_width(bitmap),
+            al_get_bitmap_height(bitmap),
 
-                coords.x - trapSize / 2, coords.y - trapSize / 2, trapSize,
-                trapSize,
+            coords.x - trapSize / 2, coords.y - trapSize / 2, trapSize,
+            trapSize,
 
-                0);
-        }
+            0);
     }
 }
 
@@ -234,14 +240,14 @@ void drawHealthBar(GameState* gameState, Player* player, Assets* assets) {
 
 void drawFurniture(GameState* gameState, Player* player, Assets* assets) {
     // Draw furniture. Furnitures are images with transparent backgrounds which
-    // are layered on top of eachother
-    for (int i = 0; i < FURNITURE_MAX; i++) {
-        if (gameState->furniture[i].data != FURNITURE_NONE &&
-            gameState->furniture[i].room == player->room) {
-            al_draw_bitmap(
-                assets->furnitureBitmaps[gameState->furniture[i].data - 1], 0,
-                0, 0);
-        }
+    // are layered on top of eachother. Only the player's room is looked at.
+    const FurnitureTable* furniture = &gameState->furniture;
+    int room = findFurnitureRoom(furniture, player->room);
+    for (int k = room >= 0 ? furniture->roomStart[room] : 0;
+         room >= 0 && k < furniture->roomStart[room + 1]; k++) {
+        int i = furniture->roomFurniture[k];
+        al_draw_bitmap(assets->furnitureBitmaps[furniture->data[i] - 1], 0, 0,
+                       0);
     }
 
     // Draw exit door if exit unlocked and right room
@@ -252,19 +258,160 @@ void drawFurniture(GameState* gameState, Player* player, Assets* assets) {
 
 void drawArrows(GameState* gameState, Player* player, Assets* assets) {
     // Up
-    if (player->room - HOUSE_W >= 0) {
+    if (roomThroughDoor(gameState, player->room, 3) >= 0) {
         al_draw_bitmap(assets->arrowBitmaps[0], 0, 0, 0);
     }
     // Left
-    if (player->room % HOUSE_W != 0) {
+    if (roomThroughDoor(gameState, player->room, 1) >= 0) {
         al_draw_bitmap(assets->arrowBitmaps[1], 0, 0, 0);
     }
     // Down
-    if (player->room + HOUSE_W < ROOM_MAX) {
+    if (roomThroughDoor(gameState, player->room, 4) >= 0) {
         al_draw_bitmap(assets->arrowBitmaps[2], 0, 0, 0);
     }
     // Right
-    if (player->room % HOUSE_W != HOUSE_W - 1) {
+    if (roomThroughDoor(gameState, player->room, 2) >= 0) {
         al_draw_bitmap(assets->arrowBitmaps[3], 0, 0, 0);
     }
 }
+
+// Draw network statistics overlay, in the top left corner
+void drawNetStats(Client* client, GameState* gameState, Assets* assets) {
+    NetStats* stats = &client->stats;
+    ALLEGRO_FONT* font = assets->statsFont;
+    ALLEGRO_COLOR color = al_map_rgb(255, 255, 255);
+    float lineHeight = al_get_font_line_height(font) + 2;
+    float x = 10;
+    float y = 10;
+
+    // Count the lines first, so the background fits
+    int lines = 5;
+    for (int tag = 0; tag < STATS_TAGS; tag++) {
+        if (stats->sent[tag].messages || stats->recieved[tag].messages) {
+            lines++;
+        }
+    }
+    al_draw_filled_rectangle(0, 0, 360, y * 2 + lines * lineHeight,
+                             al_map_rgba(0, 0, 0, 160));
+
+    al_draw_textf(font, color, x, y, 0, "rtt %.1f ms (smoothed %.1f ms)",
+                  stats->rtt * 1000.0, stats->rttSmoothed * 1000.0);
+    y += lineHeight;
+    double sendAverage =
+        stats->sendCalls ? stats->sendTime / stats->sendCalls : 0.0;
+    al_draw_textf(font, color, x, y, 0,
+                  "send %lu calls, avg %.3f ms, max %.3f ms", stats->sendCalls,
+                  sendAverage * 1000.0, stats->sendTimeMax * 1000.0);
+    y += lineHeight;
+    al_draw_textf(font, color, x, y, 0,
+                  "queue high water %zu / %zu KB, %lu datagram frames dropped",
+                  stats->queueHighWater / 1024, stats->queueCapacity / 1024,
+                  stats->datagramFramesDropped);
+    y += lineHeight;
+    al_draw_textf(font, color, x, y, 0,
+                  "positions sent %d, skipped %d, corrections %d",
+                  gameState->positionPolicy.sent,
+                  gameState->positionPolicy.suppressed,
+                  gameState->prediction.corrections);
+    y += lineHeight;
+    al_draw_textf(font, color, x, y, 0, "%c %10s %8s %10s %8s", ' ', "sent",
+                  "bytes", "recieved", "bytes");
+    y += lineHeight;
+
+    // One line per command that has been sent or recieved
+    for (int tag = 0; tag < STATS_TAGS; tag++) {
+        TrafficCount sent = stats->sent[tag];
+        TrafficCount recieved = stats->recieved[tag];
+        if (!sent.messages && !recieved.messages) continue;
+
+        al_draw_textf(font, color, x, y, 0, "%c %10lu %8lu %10lu %8lu", tag,
+                      sent.messages, sent.bytes, recieved.messages,
+                      recieved.bytes);
+        y += lineHeight;
+    }
+}
+
+// Load bitmap and quit on error
+ALLEGRO_BITMAP* loadBitmap(const char* path) {
+    ALLEGRO_BITMAP* bitmap = al_load_bitmap(path);
+    if (!bitmap) {
+        fprintf(stderr, "Failed to load bitmap: %s\n", path);
+        exit(1);
+    }
+    return bitmap;
+}
+
+// Load font and quit on error
+ALLEGRO_FONT* loadFont(const char* path, int size, int flags) {
+    ALLEGRO_FONT* font = al_load_ttf_font(path, size, flags);
+    if (!font) {
+        fprintf(stderr, "Failed to load font: %s\n", path);
+        exit(1);
+    }
+    return font;
+}
+
+// Load all assets
+void loadAssets(Assets* assets) {
+    // Trap and food enums start at one
+    assets->trapBitmaps[TRAP_CHEESE - 1] = loadBitmap("assets/cheeseTrap.png");
+    assets->trapBitmaps[TRAP_ACID - 1] = loadBitmap("assets/acidTrap.png");
+    assets->trapBitmaps[TRAP_BOMB - 1] = loadBitmap("assets/bombTrap.png");
+
+    assets->foodBitmaps[FOOD_BANANA - 1] = loadBitmap("assets/bananaFood.png");
+    assets->foodBitmaps[FOOD_CEREAL - 1] = loadBitmap("assets/cerealFood.png");
+    assets->foodBitmaps[FOOD_STRAWBERRY - 1] =
+        loadBitmap("assets/strawberryFood.png");
+    assets->foodBitmaps[FOOD_PEANUT - 1] = loadBitmap("assets/peanutFood.png");
+    assets->foodBitmaps[FOOD_PIZZA - 1] = loadBitmap("assets/pizzaFood.png");
+
+    // Player 1 images
+    assets->graySquirrelBitmaps[0] =
+        loadBitmap("assets/squirrelGrayForward.png");
+    assets->graySquirrelBitmaps[1] = loadBitmap("assets/squirrelGrayLeft.png");
+    assets->graySquirrelBitmaps[2] =
+        loadBitmap("assets/squirrelGrayBackward.png");
+    assets->graySquirrelBitmaps[3] = loadBitmap("assets/squirrelGrayRight.png");
+
+    // Arrows to move between rooms
+    assets->arrowBitmaps[0] = loadBitmap("assets/upArrow.png");
+    assets->arrowBitmaps[1] = loadBitmap("assets/leftArrow.png");
+    assets->arrowBitmaps[2] = loadBitmap("assets/downArrow.png");
+    assets->arrowBitmaps[3] = loadBitmap("assets/rightArrow.png");
+
+    // Player 2 images
+    assets->brownSquirrelBitmaps[0] =
+        loadBitmap("assets/squirrelBrownForward.png");
+    assets->brownSquirrelBitmaps[1] =
+        loadBitmap("assets/squirrelBrownLeft.png");
+    assets->brownSquirrelBitmaps[2] =
+        loadBitmap("assets/squirrelBrownBackward.png");
+    assets->brownSquirrelBitmaps[3] =
+        loadBitmap("assets/squirrelBrownRight.png");
+
+    // Furniture
+    assets->furnitureBitmaps[0] = loadBitmap("assets/cabinetFurniture.png");
+    assets->furnitureBitmaps[1] = loadBitmap("assets/carpetFurniture.png");
+    assets->furnitureBitmaps[2] = loadBitmap("assets/bookshelfFurniture.png");
+
+    // UI stuff
+    assets->grayIcon = loadBitmap("assets/grayIcon.png");
+    assets->brownIcon = loadBitmap("assets/brownIcon.png");
+    assets->slotIcon = loadBitmap("assets/slotIcon.png");
+    assets->minimapIcon = loadBitmap("assets/minimapIcon.png");
+    assets->background = loadBitmap("assets/background.png");
+    assets->foodInventoryIcon = loadBitmap("assets/foodInventoryIcon.png");
+    assets->healthBar = loadBitmap("assets/healthBar.png");
+    assets->exit = loadBitmap("assets/exit.png");
+    assets->menu = loadBitmap("assets/menu.png");
+    assets->helpScreens[0] = loadBitmap("assets/Help1.png");
+    assets->helpScreens[1] = loadBitmap("assets/Help2.png");
+    assets->helpScreens[2] = loadBitmap("assets/Help3.png");
+
+    // Small font for the network overlay. Built into Allegro, so it can't
+    // fail to load.
+    assets->statsFont = al_create_builtin_font();
+
+    // essential image
+    loadBitmap("assets/flamingo.jpg");
+}
@@ -0,0 +1,105 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                     File: interpolation.c                    *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Remote players are drawn slightly in the past, between two positions that
+// have already arrived. Packets that bunch up or arrive late then change
+// when a position is drawn, not how the squirrel moves.
+
+// Includes
+#include "interpolation.h"
+
+#include <string.h>
+
+// Get the snapshot age positions before the newest one
+static const Snapshot* snapshotAt(const SnapshotBuffer* self, int age) {
+    int i = (self->newest - age + SNAPSHOT_COUNT) % SNAPSHOT_COUNT;
+    return &self->snapshots[i];
+}
+
+// Forget all snapshots
+void snapshotClear(SnapshotBuffer* self) {
+    self->count = 0;
+    self->newest = 0;
+}
+
+// Add a snapshot
+void snapshotPush(SnapshotBuffer* self, double serverTime, double localTime,
+                  float x, float y) {
+    // The smallest difference between the two clocks is the best guess
+    // for the offset (it's the packet that was delayed least). Let it creep
+    // up slowly so a one-off fast packet doesn't pin it forever.
+    double offset = localTime - serverTime;
+    if (self->count == 0 || offset < self->clockOffset) {
+        self->clockOffset = offset;
+    } else {
+        self->clockOffset += (offset - self->clockOffset) * 0.01;
+    }
+
+    // Snapshots that arrive out of order are dropped
+    if (self->count > 0 && serverTime <= snapshotAt(self, 0)->time) {
+        return;
+    }
+
+    self->newest = (self->newest + 1) % SNAPSHOT_COUNT;
+    Snapshot* snapshot = &self->snapshots[self->newest];
+    snapshot->time = serverTime;
+    snapshot->x = x;
+    snapshot->y = y;
+    if (self->count < SNAPSHOT_COUNT) self->count++;
+}
+
+// Find the position to draw at localTime
+bool snapshotSample(const SnapshotBuffer* self, double localTime,
+                    double delay, double maxExtrapolation, float* x,
+                    float* y) {
+    if (self->count == 0) {
+        return false;
+    }
+
+    // Time to draw, on the server's clock
+    double renderTime = localTime - self->clockOffset - delay;
+    const Snapshot* newest = snapshotAt(self, 0);
+
+    // Only one snapshot, or render time is before all of them
+    const Snapshot* oldest = snapshotAt(self, self->count - 1);
+    if (self->count == 1 || renderTime <= oldest->time) {
+        *x = self->count == 1 ? newest->x : oldest->x;
+        *y = self->count == 1 ? newest->y : oldest->y;
+        return true;
+    }
+
+    // Render time is after the newest snapshot. Keep moving in the same
+    // direction for a little while, then stop.
+    if (renderTime >= newest->time) {
+        const Snapshot* previous = snapshotAt(self, 1);
+        double ahead = renderTime - newest->time;
+        if (ahead > maxExtrapolation) ahead = maxExtrapolation;
+
+        double span = newest->time - previous->time;
+        double t = span > 0.0 ? ahead / span : 0.0;
+        *x = newest->x + (float)((newest->x - previous->x) * t);
+        *y = newest->y + (float)((newest->y - previous->y) * t);
+        return true;
+    }
+
+    // Find the two snapshots around render time, newest first
+    for (int age = 0; age < self->count - 1; age++) {
+        const Snapshot* after = snapshotAt(self, age);
+        const Snapshot* before = snapshotAt(self, age + 1);
+        if (before->time <= renderTime) {
+            double t =
+                (renderTime - before->time) / (after->time - before->time);
+            *x = before->x + (float)((after->x - before->x) * t);
+            *y = before->y + (float)((after->y - before->y) * t);
+            return true;
+        }
+    }
+
+    return false;
+}
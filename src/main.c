@@ -21,22 +21,69 @@
 #include <allegro5/allegro_primitives.h>
 #include <allegro5/allegro_ttf.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "client.h"
 #include "commands.h"
 #include "game.h"
 #include "graphics.h"
+#include "replay.h"
 
-// Store key states. This system is from the allegro vivace tutorial.
-// Key states are stored via bit masks. The first bit is the key state, and the
-// second bit is whether the key has been "seen" by game logic. This prevents
-// the user pressing a key in between frames and the game not registering it.
+// Store movement key states. This system is from the allegro vivace
+// tutorial. Keys pressed are kept until the game logic has "seen" them. This
+// prevents the user pressing a key in between frames and the game not
+// registering it.
 //
-// To see how to use the masks, check comments on the KEY_SEEN and KEY_RELEASED
-// defines in "game.h".
-unsigned char key[ALLEGRO_KEY_MAX] = {0};
+// To see how it works, check the comments on MoveInput in "input.h".
+MoveInput moveInput = {0};
+
+// Direction a key moves the player in (INPUT_* bits), or 0
+static int keyDirection(int keycode) {
+    switch (keycode) {
+        case ALLEGRO_KEY_W:
+            return INPUT_UP;
+        case ALLEGRO_KEY_A:
+            return INPUT_LEFT;
+        case ALLEGRO_KEY_S:
+            return INPUT_DOWN;
+        case ALLEGRO_KEY_D:
+            return INPUT_RIGHT;
+        default:
+            return 0;
+    }
+}
+
+// What pressing a key does in game
+static Action keyAction(int keycode) {
+    switch (keycode) {
+        case ALLEGRO_KEY_1:
+            return ACTION_TRAP_CHEESE;
+        case ALLEGRO_KEY_2:
+            return ACTION_TRAP_ACID;
+        case ALLEGRO_KEY_3:
+            return ACTION_TRAP_BOMB;
+        case ALLEGRO_KEY_SPACE:
+            return ACTION_SEARCH;
+        case ALLEGRO_KEY_P:
+            return ACTION_ATTACK;
+        case ALLEGRO_KEY_F3:
+            return ACTION_TOGGLE_STATS;
+        default:
+            return ACTION_NONE;
+    }
+}
+
+// Usage: AllegroGame [-r file]
+//   -r file   record a replay of the game to file (see replay.h)
+int main(int argc, char** argv) {
+    const char* replayPath = NULL;
+    if (argc == 3 && strcmp(argv[1], "-r") == 0) {
+        replayPath = argv[2];
+    } else if (argc != 1) {
+        fprintf(stderr, "Usage: %s [-r file]\n", argv[0]);
+        return 1;
+    }
 
-int main() {
     // Initialize allegro
     al_init();
 
@@ -108,6 +155,7 @@ int main() {
 
     // Send the desired lobby to the server.
     updateLobby(client, gameState);
+    clientFlush(client);
 
     // Variables for help screen.
     bool redraw = true;
@@ -183,7 +231,23 @@ int main() {
 
     // Deltatime & related info
     double prevTime = al_get_time();
-    double dt = 0.0f;
+
+    // Network statistics, written to a CSV file for looking at later. The
+    // game runs fine without it.
+    FILE* statsFile = fopen("netstats.csv", "w");
+    if (statsFile) {
+        statsWriteHeader(statsFile);
+    } else {
+        perror("netstats.csv");
+    }
+    double statsTime = prevTime;
+
+    // Replay of the game, for playing back without a network (see
+    // replay.h), if one was asked for. Like the statistics, the game runs
+    // fine without it.
+    if (replayPath) {
+        gameState->replay = replayRecord(replayPath, gameState);
+    }
 
     // Start main loop!
     while (1) {
@@ -202,25 +266,34 @@ int main() {
                 double dt = time - prevTime;
                 prevTime = time;
 
-                runGameLogic(client, gameState, player, other, key, dt);
+                // The logic runs in fixed ticks, however long the frame was
+                runFrame(client, gameState, player, other, &moveInput, dt);
                 redraw = true;
+
+                // Write network statistics once a second
+                if (statsFile && time - statsTime >= 1.0) {
+                    statsWriteRow(&client->stats, statsFile, gameState->clock);
+                    statsTime = time;
+                }
                 break;
 
             // Key press event
             case ALLEGRO_EVENT_KEY_DOWN:
                 // Set key state to unseen and pressed. Check comments
-                // on the KEY_SEEN and KEY_RELEASED defines in "game.h".
-                key[event.keyboard.keycode] = KEY_SEEN | KEY_RELEASED;
+                // on MoveInput in "input.h".
+                moveInput.held |= keyDirection(event.keyboard.keycode);
+                moveInput.pressed |= keyDirection(event.keyboard.keycode);
 
-                // Send to keydown function
-                onKeyDown(client, gameState, event, player, other);
+                // Send to action function
+                onAction(client, gameState, keyAction(event.keyboard.keycode),
+                         player, other);
                 break;
 
             // Key release event
             case ALLEGRO_EVENT_KEY_UP:
                 // Set key state to unpresed. Check comments
-                // on the KEY_SEEN and KEY_RELEASED defines in "game.h".
-                key[event.keyboard.keycode] &= KEY_RELEASED;
+                // on MoveInput in "input.h".
+                moveInput.held &= ~keyDirection(event.keyboard.keycode);
                 break;
 
             // Close game on window close
@@ -234,6 +307,9 @@ int main() {
 
         // If frame requested & there are no more events, redraw the screen
         if (redraw && al_event_queue_is_empty(queue)) {
+            // Find where players are drawn
+            interpolatePlayers(gameState);
+
             // Draw everything, in order from back to front
             drawBackground(&assets);
             drawFurniture(gameState, player, &assets);
@@ -244,6 +320,9 @@ int main() {
             drawFoodInventory(gameState, player, &assets);
             drawMinimap(gameState, &assets);
             drawHealthBar(gameState, player, &assets);
+            if (gameState->showNetStats) {
+                drawNetStats(client, gameState, &assets);
+            }
 
             // Flip the display
             al_flip_display();
@@ -253,6 +332,14 @@ int main() {
         }
     }
 
+    // Close the statistics file and the replay
+    if (statsFile) {
+        fclose(statsFile);
+    }
+    if (gameState->replay) {
+        replayClose(gameState->replay);
+    }
+
     // Stop clients and free memory on exit
     clientStop(client);
     clientFree(client);
@@ -264,7 +351,7 @@ int main() {
     al_destroy_event_queue(queue);
 
     // Show player who won
-    Sleep(10000);
+    al_rest(10.0);
 
     return 0;
 }
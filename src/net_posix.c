@@ -0,0 +1,237 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                       File: net_posix.c                      *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// POSIX backend for net.h. The poller uses epoll on Linux, and falls back
+// to poll() on other systems.
+
+// Includes
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "net.h"
+
+// Start networking. Nothing to initialize, but writing to a socket the
+// server closed would kill the process with SIGPIPE instead of returning an
+// error.
+void netStartup(void) {
+    static bool started = false;
+    if (started) return;
+    started = true;
+
+    signal(SIGPIPE, SIG_IGN);
+}
+
+// Close a socket
+void netClose(NetSocket sock) { close(sock); }
+
+// Last socket error code
+int netLastError(void) { return errno; }
+
+// Check if the last socket call failed because it would have blocked
+bool netWouldBlock(void) { return errno == EAGAIN || errno == EWOULDBLOCK; }
+
+// Make a socket non-blocking
+int netSetNonBlocking(NetSocket sock) {
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags == -1) {
+        return -1;
+    }
+    return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Wait for a single socket
+static int waitFor(NetSocket sock, short events, int timeoutMs) {
+    struct pollfd pfd = {.fd = sock, .events = events};
+    int result = poll(&pfd, 1, timeoutMs);
+    if (result < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    return result > 0;
+}
+
+// Wait until a socket can be read from
+int netWaitReadable(NetSocket sock, int timeoutMs) {
+    return waitFor(sock, POLLIN, timeoutMs);
+}
+
+// Wait until any of a few sockets can be read from
+int netWaitAnyReadable(const NetSocket *socks, int count, int timeoutMs) {
+    struct pollfd pfds[4];
+    if (count > 4) count = 4;
+    for (int i = 0; i < count; i++) {
+        pfds[i].fd = socks[i];
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
+    }
+
+    int result = poll(pfds, count, timeoutMs);
+    if (result < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    return result > 0;
+}
+
+// Wait until a socket can be written to
+int netWaitWritable(NetSocket sock, int timeoutMs) {
+    return waitFor(sock, POLLOUT, timeoutMs);
+}
+
+// Sleep for a number of milliseconds
+void netSleep(int ms) {
+    struct timespec duration = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&duration, NULL);
+}
+
+// Seconds from the monotonic clock
+double netTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+#ifdef __linux__
+
+// epoll keeps the watched set in the kernel, so waiting costs the same no
+// matter how many sockets are idle.
+struct NetPoller {
+    int epfd;
+    int capacity;
+    struct epoll_event *events;
+};
+
+// Create a poller
+NetPoller *netPollerNew(int capacity) {
+    NetPoller *self = (NetPoller *)malloc(sizeof(NetPoller));
+    self->epfd = epoll_create1(0);
+    if (self->epfd == -1) {
+        perror("epoll_create1");
+        free(self);
+        return NULL;
+    }
+    self->capacity = capacity;
+    self->events =
+        (struct epoll_event *)malloc(sizeof(struct epoll_event) * capacity);
+    return self;
+}
+
+// Watch a socket
+int netPollerAdd(NetPoller *self, NetSocket sock, void *userData) {
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = userData};
+    return epoll_ctl(self->epfd, EPOLL_CTL_ADD, sock, &event);
+}
+
+// Stop watching a socket
+int netPollerRemove(NetPoller *self, NetSocket sock) {
+    return epoll_ctl(self->epfd, EPOLL_CTL_DEL, sock, NULL);
+}
+
+// Wait for readable sockets
+int netPollerWait(NetPoller *self, void **ready, int maxReady,
+                  int timeoutMs) {
+    if (maxReady > self->capacity) maxReady = self->capacity;
+
+    int count = epoll_wait(self->epfd, self->events, maxReady, timeoutMs);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        ready[i] = self->events[i].data.ptr;
+    }
+    return count;
+}
+
+// Free a poller
+void netPollerFree(NetPoller *self) {
+    close(self->epfd);
+    free(self->events);
+    free(self);
+}
+
+#else
+
+// poll() fallback. The watched sockets are kept in an array.
+struct NetPoller {
+    int count;
+    int capacity;
+    struct pollfd *fds;
+    void **userData;
+};
+
+// Create a poller
+NetPoller *netPollerNew(int capacity) {
+    NetPoller *self = (NetPoller *)malloc(sizeof(NetPoller));
+    self->count = 0;
+    self->capacity = capacity;
+    self->fds = (struct pollfd *)malloc(sizeof(struct pollfd) * capacity);
+    self->userData = (void **)malloc(sizeof(void *) * capacity);
+    return self;
+}
+
+// Watch a socket
+int netPollerAdd(NetPoller *self, NetSocket sock, void *userData) {
+    if (self->count == self->capacity) {
+        return -1;
+    }
+    self->fds[self->count].fd = sock;
+    self->fds[self->count].events = POLLIN;
+    self->fds[self->count].revents = 0;
+    self->userData[self->count] = userData;
+    self->count++;
+    return 0;
+}
+
+// Stop watching a socket. The last socket is moved into its place.
+int netPollerRemove(NetPoller *self, NetSocket sock) {
+    for (int i = 0; i < self->count; i++) {
+        if (self->fds[i].fd == sock) {
+            self->count--;
+            self->fds[i] = self->fds[self->count];
+            self->userData[i] = self->userData[self->count];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Wait for readable sockets
+int netPollerWait(NetPoller *self, void **ready, int maxReady,
+                  int timeoutMs) {
+    int result = poll(self->fds, self->count, timeoutMs);
+    if (result < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    int count = 0;
+    for (int i = 0; i < self->count && count < maxReady; i++) {
+        if (self->fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ready[count++] = self->userData[i];
+        }
+    }
+    return count;
+}
+
+// Free a poller
+void netPollerFree(NetPoller *self) {
+    free(self->fds);
+    free(self->userData);
+    free(self);
+}
+
+#endif
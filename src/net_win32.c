@@ -0,0 +1,198 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                       File: net_win32.c                      *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Winsock backend for net.h. The poller uses WSAPoll, which needs Windows
+// Vista or newer.
+
+// WSAPoll is only declared for Vista and newer
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
+
+// Defining WIN32_LEAN_AND_MEAN omits winsock from windows.h
+// This allows winsock2 to be included separately
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "net.h"
+
+// Start networking. Initializes Winsock 2.2, and cleans it up at exit.
+void netStartup(void) {
+    // Only initialize once, no matter how many clients there are
+    static bool started = false;
+    if (started) return;
+    started = true;
+
+    // Setup for windows sockets
+    WSADATA wsaData;
+
+    // Initialize winsock and check for errors
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        fprintf(stderr, "WSAStartup failed.\n");
+        exit(1);
+    }
+
+    // Check if Winsock 2.2 is available
+    if (LOBYTE(wsaData.wVersion) != 2 || HIBYTE(wsaData.wVersion) != 2) {
+        fprintf(stderr, "Versiion 2.2 of Winsock is not available.\n");
+        WSACleanup();
+        exit(2);
+    }
+
+    printf("Winsock initialized.\n");
+
+    // Run cleanup at program exit
+    atexit((void (*)(void))WSACleanup);
+}
+
+// Close a socket
+void netClose(NetSocket sock) { closesocket((SOCKET)sock); }
+
+// Last socket error code
+int netLastError(void) { return WSAGetLastError(); }
+
+// Check if the last socket call failed because it would have blocked
+bool netWouldBlock(void) { return WSAGetLastError() == WSAEWOULDBLOCK; }
+
+// Make a socket non-blocking
+int netSetNonBlocking(NetSocket sock) {
+    u_long mode = 1;
+    return ioctlsocket((SOCKET)sock, FIONBIO, &mode) == 0 ? 0 : -1;
+}
+
+// Wait for a single socket
+static int waitFor(NetSocket sock, short events, int timeoutMs) {
+    WSAPOLLFD pfd = {.fd = (SOCKET)sock, .events = events};
+    int result = WSAPoll(&pfd, 1, timeoutMs);
+    if (result == SOCKET_ERROR) {
+        return -1;
+    }
+    return result > 0;
+}
+
+// Wait until a socket can be read from
+int netWaitReadable(NetSocket sock, int timeoutMs) {
+    return waitFor(sock, POLLRDNORM, timeoutMs);
+}
+
+// Wait until any of a few sockets can be read from
+int netWaitAnyReadable(const NetSocket *socks, int count, int timeoutMs) {
+    WSAPOLLFD pfds[4];
+    if (count > 4) count = 4;
+    for (int i = 0; i < count; i++) {
+        pfds[i].fd = (SOCKET)socks[i];
+        pfds[i].events = POLLRDNORM;
+        pfds[i].revents = 0;
+    }
+
+    int result = WSAPoll(pfds, count, timeoutMs);
+    if (result == SOCKET_ERROR) {
+        return -1;
+    }
+    return result > 0;
+}
+
+// Wait until a socket can be written to
+int netWaitWritable(NetSocket sock, int timeoutMs) {
+    return waitFor(sock, POLLWRNORM, timeoutMs);
+}
+
+// Sleep for a number of milliseconds
+void netSleep(int ms) { Sleep(ms); }
+
+// Seconds from the performance counter
+double netTime(void) {
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / frequency.QuadPart;
+}
+
+// WSAPoll works on an array of sockets, like poll() on POSIX.
+struct NetPoller {
+    int count;
+    int capacity;
+    WSAPOLLFD *fds;
+    void **userData;
+};
+
+// Create a poller
+NetPoller *netPollerNew(int capacity) {
+    NetPoller *self = (NetPoller *)malloc(sizeof(NetPoller));
+    self->count = 0;
+    self->capacity = capacity;
+    self->fds = (WSAPOLLFD *)malloc(sizeof(WSAPOLLFD) * capacity);
+    self->userData = (void **)malloc(sizeof(void *) * capacity);
+    return self;
+}
+
+// Watch a socket
+int netPollerAdd(NetPoller *self, NetSocket sock, void *userData) {
+    if (self->count == self->capacity) {
+        return -1;
+    }
+    self->fds[self->count].fd = (SOCKET)sock;
+    self->fds[self->count].events = POLLRDNORM;
+    self->fds[self->count].revents = 0;
+    self->userData[self->count] = userData;
+    self->count++;
+    return 0;
+}
+
+// Stop watching a socket. The last socket is moved into its place.
+int netPollerRemove(NetPoller *self, NetSocket sock) {
+    for (int i = 0; i < self->count; i++) {
+        if (self->fds[i].fd == (SOCKET)sock) {
+            self->count--;
+            self->fds[i] = self->fds[self->count];
+            self->userData[i] = self->userData[self->count];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Wait for readable sockets
+int netPollerWait(NetPoller *self, void **ready, int maxReady,
+                  int timeoutMs) {
+    // WSAPoll fails on an empty set, so just wait out the timeout
+    if (self->count == 0) {
+        if (timeoutMs > 0) Sleep(timeoutMs);
+        return 0;
+    }
+
+    int result = WSAPoll(self->fds, self->count, timeoutMs);
+    if (result == SOCKET_ERROR) {
+        return -1;
+    }
+
+    int count = 0;
+    for (int i = 0; i < self->count && count < maxReady; i++) {
+        if (self->fds[i].revents & (POLLRDNORM | POLLHUP | POLLERR)) {
+            ready[count++] = self->userData[i];
+        }
+    }
+    return count;
+}
+
+// Free a poller
+void netPollerFree(NetPoller *self) {
+    free(self->fds);
+    free(self->userData);
+    free(self);
+}
@@ -0,0 +1,90 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                       File: netstats.c                       *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Network statistics, shown in the overlay (F3) and written to a CSV file.
+
+// Includes
+#include "netstats.h"
+
+// Command tags that get their own CSV columns
+static const char csvTags[] = "PRTKICOFAMQGH";
+
+// Count a message for a command tag
+void statsCount(TrafficCount* counts, int tag, int bytes) {
+    if (tag < 0 || tag >= STATS_TAGS) {
+        return;
+    }
+    counts[tag].messages++;
+    counts[tag].bytes += bytes;
+}
+
+// Record how long a send took
+void statsSend(NetStats* self, double seconds) {
+    self->sendCalls++;
+    self->sendTime += seconds;
+    if (seconds > self->sendTimeMax) {
+        self->sendTimeMax = seconds;
+    }
+}
+
+// Record a round trip time. The smoothed value moves an eighth of the way
+// to each new sample, like TCP's.
+void statsRoundTrip(NetStats* self, double rtt) {
+    if (self->rttSmoothed == 0.0) {
+        self->rttSmoothed = rtt;
+    } else {
+        self->rttSmoothed += (rtt - self->rttSmoothed) / 8.0;
+    }
+    self->rtt = rtt;
+}
+
+// Total messages and bytes over all tags
+TrafficCount statsTotal(const TrafficCount* counts) {
+    TrafficCount total = {0, 0};
+    for (int i = 0; i < STATS_TAGS; i++) {
+        total.messages += counts[i].messages;
+        total.bytes += counts[i].bytes;
+    }
+    return total;
+}
+
+// Write the CSV column names
+void statsWriteHeader(FILE* file) {
+    fprintf(file,
+            "time,rtt_ms,rtt_smoothed_ms,send_calls,send_avg_ms,send_max_ms,"
+            "queue_high_water,queue_capacity,datagram_frames_dropped,"
+            "sent_messages,sent_bytes,recieved_messages,recieved_bytes");
+    for (const char* tag = csvTags; *tag; tag++) {
+        fprintf(file, ",sent_%c_messages,sent_%c_bytes", *tag, *tag);
+        fprintf(file, ",recieved_%c_messages,recieved_%c_bytes", *tag, *tag);
+    }
+    fprintf(file, "\n");
+}
+
+// Write the current counters as a CSV row. Counters are totals since the
+// client started.
+void statsWriteRow(const NetStats* self, FILE* file, double time) {
+    double sendAverage =
+        self->sendCalls ? self->sendTime / self->sendCalls : 0.0;
+    TrafficCount sent = statsTotal(self->sent);
+    TrafficCount recieved = statsTotal(self->recieved);
+
+    fprintf(file, "%.3f,%.3f,%.3f,%lu,%.4f,%.4f,%zu,%zu,%lu,%lu,%lu,%lu,%lu",
+            time, self->rtt * 1000.0, self->rttSmoothed * 1000.0,
+            self->sendCalls, sendAverage * 1000.0, self->sendTimeMax * 1000.0,
+            self->queueHighWater, self->queueCapacity,
+            self->datagramFramesDropped, sent.messages, sent.bytes,
+            recieved.messages, recieved.bytes);
+    for (const char* tag = csvTags; *tag; tag++) {
+        fprintf(file, ",%lu,%lu,%lu,%lu", self->sent[(int)*tag].messages,
+                self->sent[(int)*tag].bytes, self->recieved[(int)*tag].messages,
+                self->recieved[(int)*tag].bytes);
+    }
+    fprintf(file, "\n");
+}
@@ -0,0 +1,72 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                      File: prediction.c                      *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Client-side prediction. The player moves as soon as a key is held, and
+// each tick of input is numbered and sent to the server, which moves the
+// player the same way and acknowledges with where it ended up. If that
+// doesn't match what was predicted, the client starts from the server's
+// position and replays the inputs the server hasn't seen yet.
+
+// Includes
+#include "prediction.h"
+
+// Get the i-th unacknowledged input
+InputTick* predictionPending(Prediction* self, int i) {
+    return &self->pending[(self->first + i) % INPUT_HISTORY];
+}
+
+// Record an input
+InputTick* predictionRecord(Prediction* self, int input, int duration) {
+    // If the server has fallen this far behind, forget the oldest input. A
+    // late acknowledgement for it is treated as a misprediction.
+    if (self->count == INPUT_HISTORY) {
+        self->first = (self->first + 1) % INPUT_HISTORY;
+        self->count--;
+    }
+
+    InputTick* tick = predictionPending(self, self->count);
+    self->count++;
+    tick->sequence = ++self->sequence;
+    tick->input = input;
+    tick->duration = duration;
+    return tick;
+}
+
+// Drop inputs the server has applied
+int predictionAcknowledge(Prediction* self, unsigned int sequence,
+                          InputTick* acknowledged) {
+    // Acknowledgements arrive in order, so anything not newer than the last
+    // one is a leftover from before a teleport
+    if (sequence <= self->acknowledged || sequence > self->sequence) {
+        return -1;
+    }
+    self->acknowledged = sequence;
+
+    int found = 0;
+    while (self->count > 0) {
+        InputTick* tick = predictionPending(self, 0);
+        if (tick->sequence > sequence) {
+            break;
+        }
+        if (tick->sequence == sequence) {
+            *acknowledged = *tick;
+            found = 1;
+        }
+        self->first = (self->first + 1) % INPUT_HISTORY;
+        self->count--;
+    }
+    return found;
+}
+
+// Forget pending inputs after a teleport
+void predictionTeleport(Prediction* self) {
+    self->first = 0;
+    self->count = 0;
+    self->acknowledged = self->sequence;
+}
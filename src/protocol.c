@@ -0,0 +1,621 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                       File: protocol.c                       *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Encoding and decoding of network commands. The fields of each message
+// are listed in messages.h, and everything here is generated from those
+// lists, so the encoders and decoders can't disagree.
+//
+// Text protocol: comma separated, one command per line. Commands sent to the
+// server are prefixed with the lobby number.
+//   Server -> client: P,pid,x,y[,time]
+//   Client -> server: lobby,P,pid,x,y
+//
+// Binary protocol: |length (u16)|tag (u8)|payload|, little-endian, with
+// positions in 1/32 pixels and damage in 1/100 points. The lobby number is
+// known from the join, so it isn't repeated. Payloads:
+//   P: player u8, x u16, y u16
+//      player u8, x u16, y u16[, time u32] (server -> client)
+//   R: player u8, room u16
+//   T: owner u8, trap data u8, room u16, x u16, y u16
+//      owner u8, trap data u8, room u16, x u16, y u16, trap id u16
+//      (server -> client)
+//   K: reason bytes
+//   I: player u8, furniture i16, item u8
+//   C: target u8, damage u16 (client -> server)
+//      damage u16            (server -> client)
+//   O: winner u8
+//   F: player u8, facing u8
+//   A: trap id u16
+//   M: player u8, sequence u32, input u8, duration u8 (client -> server)
+//   Q: sequence u32, x u16, y u16, room u16 (server -> client)
+//   G: sequence u32 (client -> server)
+//   H: sequence u32 (server -> client)
+//   W: nothing (server -> client)
+//   Z: game state bytes
+//
+// The server gives each trap an ID when it's placed, and sends it with the
+// T. A names the trap by that ID in both directions.
+//
+// The server stamps positions it relays with its clock, in milliseconds.
+// Remote players are interpolated between these (see interpolation.c).
+//
+// With prediction, clients send their movement keys each tick as M, and the
+// server answers with Q: where the input left the player.
+//
+// G (ping) is answered by H (pong) with the same sequence, to measure the
+// round trip time.
+//
+// When a player joins a game that already started (or comes back after
+// dropping), the server asks the other client for its game state with W.
+// The client answers with Z, which the server passes on to the player
+// joining. Z only exists in the binary protocol.
+//
+// J (join), V (version), U (UDP token) and E (features) are always sent as
+// text. V marks the point where the side that sent it switches to the
+// negotiated protocol. The join is J,lobby,version,features. The server
+// answers with E,features, then U,token if it accepted the UDP feature,
+// then its V line.
+
+// Includes
+#include "protocol.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "messages.h"
+
+// Read little-endian values from a binary payload
+static int readU8(const unsigned char *p) { return p[0]; }
+static int readU16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+static int readI16(const unsigned char *p) { return (short)readU16(p); }
+static unsigned readU32(const unsigned char *p) {
+    return (unsigned)readU16(p) | ((unsigned)readU16(p + 2) << 16);
+}
+
+// Write little-endian values to a binary payload
+static void writeU8(unsigned char *p, int value) {
+    p[0] = (unsigned char)value;
+}
+static void writeU16(unsigned char *p, int value) {
+    p[0] = (unsigned char)(value & 0xff);
+    p[1] = (unsigned char)((value >> 8) & 0xff);
+}
+static void writeU32(unsigned char *p, unsigned value) {
+    writeU16(p, value & 0xffff);
+    writeU16(p + 2, value >> 16);
+}
+
+// Check a value against a field's range. Written so NaN fails.
+#define IN_RANGE(value, min, max) ((value) >= (min) && (value) <= (max))
+
+// Cursor over a message being decoded. Text fields are separated by commas,
+// and anything after the last field of a text message is ignored. Binary
+// payloads have to be exactly as long as their fields.
+typedef struct {
+    const char *p;
+    const char *end;
+} TextCursor;
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+} BinaryCursor;
+
+// Where a message is being encoded. full is set when a field didn't fit,
+// so running out of space can be told apart from a value out of range.
+typedef struct {
+    char *p;
+    char *end;
+    bool full;
+} Writer;
+
+// Text numbers are parsed by hand, so the result doesn't depend on the
+// locale (sscanf and strtof expect a ',' decimal point in some).
+
+// Largest mantissa accumulated when parsing decimals. Digits past this only
+// move the exponent.
+#define MANTISSA_MAX 100000000000000000ULL
+
+// Powers of ten that are exact as doubles
+static const double powersOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Move past the comma before a field
+static bool textComma(TextCursor *cursor) {
+    if (cursor->p < cursor->end && *cursor->p == ',') {
+        cursor->p++;
+        return true;
+    }
+    return false;
+}
+
+// Read digits into an unsigned value. Fails on no digits, or on overflow.
+static bool textDigits(TextCursor *cursor, unsigned long long max,
+                       unsigned long long *out) {
+    const char *start = cursor->p;
+    unsigned long long value = 0;
+    while (cursor->p < cursor->end && isDigit(*cursor->p)) {
+        value = value * 10 + (*cursor->p - '0');
+        if (value > max) return false;
+        cursor->p++;
+    }
+    *out = value;
+    return cursor->p != start;
+}
+
+// Read an integer, like -12
+static bool textInt(TextCursor *cursor, int *out) {
+    bool negative = cursor->p < cursor->end && *cursor->p == '-';
+    if (cursor->p < cursor->end && (*cursor->p == '-' || *cursor->p == '+')) {
+        cursor->p++;
+    }
+
+    unsigned long long value;
+    if (!textDigits(cursor, 2147483648ULL, &value)) return false;
+    if (!negative && value > 2147483647ULL) return false;
+    *out = negative ? (int)-(long long)value : (int)value;
+    return true;
+}
+
+// Read a decimal number, like 12.5, -3 or 1e-05 (Python writes very small
+// numbers with an exponent). The digits are collected into an integer and
+// scaled by a power of ten once at the end.
+static bool textDecimal(TextCursor *cursor, float *out) {
+    const char *p = cursor->p;
+    const char *end = cursor->end;
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) p++;
+
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    for (; p < end && isDigit(*p); p++, digits++) {
+        if (mantissa < MANTISSA_MAX) {
+            mantissa = mantissa * 10 + (*p - '0');
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && isDigit(*p); p++, digits++) {
+            if (mantissa < MANTISSA_MAX) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+    if (digits == 0) return false;
+
+    // Exponent, if any
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        TextCursor exponentCursor = {p + 1, end};
+        bool negativeExponent =
+            exponentCursor.p < end && *exponentCursor.p == '-';
+        if (exponentCursor.p < end &&
+            (*exponentCursor.p == '-' || *exponentCursor.p == '+')) {
+            exponentCursor.p++;
+        }
+        unsigned long long value;
+        if (!textDigits(&exponentCursor, 1000, &value)) return false;
+        exponent += negativeExponent ? -(int)value : (int)value;
+        p = exponentCursor.p;
+    }
+
+    double value = (double)mantissa;
+    while (exponent > 22) {
+        value *= 1e22;
+        exponent -= 22;
+    }
+    while (exponent < -22) {
+        value /= 1e22;
+        exponent += 22;
+    }
+    value = exponent >= 0 ? value * powersOfTen[exponent]
+                          : value / powersOfTen[-exponent];
+
+    *out = (float)(negative ? -value : value);
+    cursor->p = p;
+    return true;
+}
+
+// Text field decoders, one per kind in messages.h. Each reads the comma and
+// the value after it. Integers look the same whatever their width.
+static bool decodeTextInt(TextCursor *cursor, int *out, int min, int max) {
+    return textComma(cursor) && textInt(cursor, out) &&
+           IN_RANGE(*out, min, max);
+}
+#define decodeTextU8 decodeTextInt
+#define decodeTextU16 decodeTextInt
+#define decodeTextI16 decodeTextInt
+#define decodeTextINT decodeTextInt
+
+static bool decodeTextU32(TextCursor *cursor, unsigned *out, unsigned min,
+                          unsigned max) {
+    unsigned long long value;
+    if (!textComma(cursor) || !textDigits(cursor, 4294967295ULL, &value)) {
+        return false;
+    }
+    *out = (unsigned)value;
+    return IN_RANGE(*out, min, max);
+}
+
+static bool decodeTextDecimal(TextCursor *cursor, float *out, float min,
+                              float max) {
+    return textComma(cursor) && textDecimal(cursor, out) &&
+           IN_RANGE(*out, min, max);
+}
+#define decodeTextPOS decodeTextDecimal
+#define decodeTextDAMAGE decodeTextDecimal
+
+// Optional, so a missing or unreadable time is -1
+static bool decodeTextTIME(TextCursor *cursor, double *out, unsigned min,
+                           unsigned max) {
+    unsigned milliseconds;
+    *out = decodeTextU32(cursor, &milliseconds, min, max)
+               ? milliseconds / 1000.0
+               : -1.0;
+    return true;
+}
+
+static bool decodeTextREASON(TextCursor *cursor, char (*out)[REASON_MAX],
+                             int min, int max) {
+    if (!textComma(cursor)) return false;
+
+    int length = (int)(cursor->end - cursor->p);
+    if (length > max) length = max;
+    if (length < min) return false;
+    memcpy(*out, cursor->p, length);
+    (*out)[length] = '\0';
+    cursor->p += length;
+    return true;
+}
+
+// Blobs can't be written in text
+static bool decodeTextBLOB(TextCursor *cursor, Blob *out, int min, int max) {
+    return false;
+}
+
+// Binary field decoders
+static bool decodeBinaryU8(BinaryCursor *cursor, int *out, int min, int max) {
+    if (cursor->end - cursor->p < 1) return false;
+    *out = readU8(cursor->p);
+    cursor->p += 1;
+    return IN_RANGE(*out, min, max);
+}
+
+static bool decodeBinaryU16(BinaryCursor *cursor, int *out, int min,
+                            int max) {
+    if (cursor->end - cursor->p < 2) return false;
+    *out = readU16(cursor->p);
+    cursor->p += 2;
+    return IN_RANGE(*out, min, max);
+}
+
+static bool decodeBinaryI16(BinaryCursor *cursor, int *out, int min,
+                            int max) {
+    if (cursor->end - cursor->p < 2) return false;
+    *out = readI16(cursor->p);
+    cursor->p += 2;
+    return IN_RANGE(*out, min, max);
+}
+
+static bool decodeBinaryU32(BinaryCursor *cursor, unsigned *out,
+                            unsigned min, unsigned max) {
+    if (cursor->end - cursor->p < 4) return false;
+    *out = readU32(cursor->p);
+    cursor->p += 4;
+    return IN_RANGE(*out, min, max);
+}
+
+// Fixed point values are u16s, divided by their scale
+static bool decodeBinaryFixed(BinaryCursor *cursor, float *out, float scale,
+                              float min, float max) {
+    if (cursor->end - cursor->p < 2) return false;
+    *out = readU16(cursor->p) / scale;
+    cursor->p += 2;
+    return IN_RANGE(*out, min, max);
+}
+
+static bool decodeBinaryPOS(BinaryCursor *cursor, float *out, float min,
+                            float max) {
+    return decodeBinaryFixed(cursor, out, POSITION_SCALE, min, max);
+}
+
+static bool decodeBinaryDAMAGE(BinaryCursor *cursor, float *out, float min,
+                               float max) {
+    return decodeBinaryFixed(cursor, out, DAMAGE_SCALE, min, max);
+}
+
+// Optional, so a payload that ends before it gives -1
+static bool decodeBinaryTIME(BinaryCursor *cursor, double *out, unsigned min,
+                             unsigned max) {
+    if (cursor->p == cursor->end) {
+        *out = -1.0;
+        return true;
+    }
+
+    unsigned milliseconds;
+    if (!decodeBinaryU32(cursor, &milliseconds, min, max)) return false;
+    *out = milliseconds / 1000.0;
+    return true;
+}
+
+static bool decodeBinaryREASON(BinaryCursor *cursor, char (*out)[REASON_MAX],
+                               int min, int max) {
+    int length = (int)(cursor->end - cursor->p);
+    if (length > max) length = max;
+    if (length < min) return false;
+    memcpy(*out, cursor->p, length);
+    (*out)[length] = '\0';
+    // Anything past the longest reason is dropped
+    cursor->p = cursor->end;
+    return true;
+}
+
+static bool decodeBinaryBLOB(BinaryCursor *cursor, Blob *out, int min,
+                             int max) {
+    int length = (int)(cursor->end - cursor->p);
+    if (!IN_RANGE(length, min, max)) return false;
+    out->data = (const char *)cursor->p;
+    out->length = length;
+    cursor->p = cursor->end;
+    return true;
+}
+
+// Check that count more bytes fit
+static bool hasRoom(Writer *out, long count) {
+    if (out->end - out->p < count) {
+        out->full = true;
+        return false;
+    }
+    return true;
+}
+
+// Writing text
+static bool writeChar(Writer *out, char c) {
+    if (!hasRoom(out, 1)) return false;
+    *out->p++ = c;
+    return true;
+}
+
+static bool writeNumber(Writer *out, long long value) {
+    char digits[24];
+    int count = 0;
+    unsigned long long magnitude = (unsigned long long)value;
+    if (value < 0) magnitude = 0 - magnitude;
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (!hasRoom(out, count + (value < 0))) return false;
+    if (value < 0) *out->p++ = '-';
+    while (count) *out->p++ = digits[--count];
+    return true;
+}
+
+// Text field encoders. Each writes the comma and the value after it.
+static bool encodeTextInt(Writer *out, int value, int min, int max) {
+    return IN_RANGE(value, min, max) && writeChar(out, ',') &&
+           writeNumber(out, value);
+}
+#define encodeTextU8 encodeTextInt
+#define encodeTextU16 encodeTextInt
+#define encodeTextI16 encodeTextInt
+#define encodeTextINT encodeTextInt
+
+static bool encodeTextU32(Writer *out, unsigned value, unsigned min,
+                          unsigned max) {
+    return IN_RANGE(value, min, max) && writeChar(out, ',') &&
+           writeNumber(out, value);
+}
+
+// Decimals are written with two places, like %.2f
+static bool encodeTextDecimal(Writer *out, float value, float min,
+                              float max) {
+    if (!IN_RANGE(value, min, max)) return false;
+
+    long long hundredths = llround(value * 100.0);
+    bool negative = hundredths < 0;
+    if (negative) hundredths = -hundredths;
+    return writeChar(out, ',') && (!negative || writeChar(out, '-')) &&
+           writeNumber(out, hundredths / 100) && writeChar(out, '.') &&
+           writeChar(out, (char)('0' + hundredths / 10 % 10)) &&
+           writeChar(out, (char)('0' + hundredths % 10));
+}
+#define encodeTextPOS encodeTextDecimal
+#define encodeTextDAMAGE encodeTextDecimal
+
+static bool encodeTextBLOB(Writer *out, Blob value, int min, int max) {
+    return false;
+}
+
+// Binary field encoders
+static bool encodeBinaryU8(Writer *out, int value, int min, int max) {
+    if (!IN_RANGE(value, min, max) || !hasRoom(out, 1)) return false;
+    writeU8((unsigned char *)out->p, value);
+    out->p += 1;
+    return true;
+}
+
+static bool encodeBinaryU16(Writer *out, int value, int min, int max) {
+    if (!IN_RANGE(value, min, max) || !hasRoom(out, 2)) return false;
+    writeU16((unsigned char *)out->p, value);
+    out->p += 2;
+    return true;
+}
+#define encodeBinaryI16 encodeBinaryU16
+
+static bool encodeBinaryU32(Writer *out, unsigned value, unsigned min,
+                            unsigned max) {
+    if (!IN_RANGE(value, min, max) || !hasRoom(out, 4)) return false;
+    writeU32((unsigned char *)out->p, value);
+    out->p += 4;
+    return true;
+}
+
+// Fixed point values are rounded to the nearest step of 1/scale
+static bool encodeBinaryFixed(Writer *out, float value, float scale,
+                              float min, float max) {
+    if (!IN_RANGE(value, min, max)) return false;
+    return encodeBinaryU16(out, (int)lroundf(value * scale), ANY_U16);
+}
+
+static bool encodeBinaryPOS(Writer *out, float value, float min, float max) {
+    return encodeBinaryFixed(out, value, POSITION_SCALE, min, max);
+}
+
+static bool encodeBinaryDAMAGE(Writer *out, float value, float min,
+                               float max) {
+    return encodeBinaryFixed(out, value, DAMAGE_SCALE, min, max);
+}
+
+static bool encodeBinaryBLOB(Writer *out, Blob value, int min, int max) {
+    if (!IN_RANGE(value.length, min, max) || !hasRoom(out, value.length))
+        return false;
+    memcpy(out->p, value.data, value.length);
+    out->p += value.length;
+    return true;
+}
+
+// Generate a decoder and an encoder for each message in each protocol, by
+// calling the field functions above in the order messages.h lists them.
+#define DECODE_TEXT_FIELD(kind, member, range) \
+    if (!decodeText##kind(cursor, &command->member, range)) return false;
+#define DECODE_BINARY_FIELD(kind, member, range) \
+    if (!decodeBinary##kind(cursor, &command->member, range)) return false;
+#define ENCODE_TEXT_FIELD(kind, member, range) \
+    if (!encodeText##kind(out, command->member, range)) return false;
+#define ENCODE_BINARY_FIELD(kind, member, range) \
+    if (!encodeBinary##kind(out, command->member, range)) return false;
+
+#define DECODE_TEXT_MESSAGE(tag, name, fields)                          \
+    static bool decodeText##name(TextCursor *cursor, Command *command) { \
+        fields(DECODE_TEXT_FIELD) return true;                          \
+    }
+#define DECODE_BINARY_MESSAGE(tag, name, fields)                     \
+    static bool decodeBinary##name(BinaryCursor *cursor,             \
+                                   Command *command) {               \
+        fields(DECODE_BINARY_FIELD) return cursor->p == cursor->end; \
+    }
+#define ENCODE_TEXT_MESSAGE(tag, name, fields)                        \
+    static bool encodeText##name(Writer *out, const Command *command) { \
+        fields(ENCODE_TEXT_FIELD) return true;                        \
+    }
+#define ENCODE_BINARY_MESSAGE(tag, name, fields)                        \
+    static bool encodeBinary##name(Writer *out, const Command *command) { \
+        fields(ENCODE_BINARY_FIELD) return true;                        \
+    }
+
+SERVER_MESSAGES(DECODE_TEXT_MESSAGE)
+SERVER_MESSAGES(DECODE_BINARY_MESSAGE)
+CLIENT_MESSAGES(ENCODE_TEXT_MESSAGE)
+CLIENT_MESSAGES(ENCODE_BINARY_MESSAGE)
+NEGOTIATION_MESSAGES(DECODE_TEXT_MESSAGE)
+NEGOTIATION_MESSAGES(ENCODE_TEXT_MESSAGE)
+
+// Tables of the generated functions, by tag
+typedef bool (*TextDecoder)(TextCursor *cursor, Command *command);
+typedef bool (*BinaryDecoder)(BinaryCursor *cursor, Command *command);
+typedef bool (*Encoder)(Writer *out, const Command *command);
+
+#define TEXT_DECODER_ENTRY(tag, name, fields) [tag] = decodeText##name,
+#define BINARY_DECODER_ENTRY(tag, name, fields) [tag] = decodeBinary##name,
+#define TEXT_ENCODER_ENTRY(tag, name, fields) [tag] = encodeText##name,
+#define BINARY_ENCODER_ENTRY(tag, name, fields) [tag] = encodeBinary##name,
+
+static const TextDecoder textDecoders[128] = {
+    SERVER_MESSAGES(TEXT_DECODER_ENTRY)
+        NEGOTIATION_MESSAGES(TEXT_DECODER_ENTRY)};
+static const BinaryDecoder binaryDecoders[128] = {
+    SERVER_MESSAGES(BINARY_DECODER_ENTRY)};
+static const Encoder textEncoders[128] = {
+    CLIENT_MESSAGES(TEXT_ENCODER_ENTRY)
+        NEGOTIATION_MESSAGES(TEXT_ENCODER_ENTRY)};
+static const Encoder binaryEncoders[128] = {
+    CLIENT_MESSAGES(BINARY_ENCODER_ENTRY)};
+
+// Check if a command is a negotiation message
+static bool isNegotiation(int type) {
+    switch (type) {
+#define NEGOTIATION_CASE(tag, name, fields) case tag:
+        NEGOTIATION_MESSAGES(NEGOTIATION_CASE)
+        return true;
+        default:
+            return false;
+    }
+}
+
+// Decode a command sent by the server.
+bool decodeCommand(const char *data, int length, int protocol,
+                   Command *command) {
+    memset(command, 0, sizeof(Command));
+    if (length < 1 || (unsigned char)data[0] >= 128) {
+        return false;
+    }
+    command->type = data[0];
+
+    if (protocol == PROTOCOL_BINARY) {
+        BinaryDecoder decoder = binaryDecoders[(unsigned char)data[0]];
+        BinaryCursor cursor = {(const unsigned char *)data + 1,
+                               (const unsigned char *)data + length};
+        return decoder && decoder(&cursor, command);
+    }
+
+    TextDecoder decoder = textDecoders[(unsigned char)data[0]];
+    TextCursor cursor = {data + 1, data + length};
+    return decoder && decoder(&cursor, command);
+}
+
+// Encode a command to send to the server.
+int encodeCommand(const Command *command, int protocol, int lobby, char *out,
+                  int size) {
+    if (command->type < 0 || command->type >= 128) {
+        return -2;
+    }
+    Writer writer = {out, out + size, false};
+
+    // Negotiation commands are always text
+    bool negotiation = isNegotiation(command->type);
+    if (protocol == PROTOCOL_BINARY && !negotiation) {
+        // Header: length of tag and payload, then the tag
+        Encoder encoder = binaryEncoders[command->type];
+        if (!encoder) {
+            return -2;
+        }
+        if (size < FRAME_HEADER_SIZE + 1) {
+            return -1;
+        }
+        writer.p += FRAME_HEADER_SIZE;
+        writeChar(&writer, (char)command->type);
+        if (!encoder(&writer, command)) {
+            return writer.full ? -1 : -2;
+        }
+
+        int length = (int)(writer.p - out);
+        writeU16((unsigned char *)out, length - FRAME_HEADER_SIZE);
+        return length;
+    }
+
+    // Commands sent to a lobby start with its number
+    Encoder encoder = textEncoders[command->type];
+    if (!encoder) {
+        return -2;
+    }
+    if ((!negotiation &&
+         !(writeNumber(&writer, lobby) && writeChar(&writer, ','))) ||
+        !writeChar(&writer, (char)command->type) ||
+        !encoder(&writer, command) || !writeChar(&writer, '\n')) {
+        return writer.full ? -1 : -2;
+    }
+    return (int)(writer.p - out);
+}
@@ -0,0 +1,116 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                       File: proximity.c                      *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Batch distance checks. Squared distances are compared against squared
+// radii, so there's no square root, and several points are checked at once
+// with AVX2 (8 at a time) or SSE2 (4 at a time). Every x86-64 processor has
+// SSE2; AVX2 is used when the game is built with AllegroGame_AVX2. Other
+// processors check one point at a time.
+
+// Includes
+#include "proximity.h"
+
+#include <stddef.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PROXIMITY_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PROXIMITY_SSE2
+#endif
+
+// Count the bits set in a word
+static int countBits(uint32_t word) {
+#ifdef __GNUC__
+    return __builtin_popcount(word);
+#else
+    int count = 0;
+    for (; word; word &= word - 1) count++;
+    return count;
+#endif
+}
+
+// Check points against one radius, or a radius each if radii isn't NULL.
+// Each word of hits covers 32 points. The vector loops fill in as much of a
+// word as they can, and the rest is done one point at a time.
+static int proximityKernel(const float* xs, const float* ys,
+                           const float* radii, float radius, int count,
+                           float x, float y, uint32_t* hits) {
+    int hitCount = 0;
+
+#if defined(PROXIMITY_AVX2)
+    __m256 centerX = _mm256_set1_ps(x);
+    __m256 centerY = _mm256_set1_ps(y);
+    __m256 radiusSquared = _mm256_set1_ps(radius * radius);
+#elif defined(PROXIMITY_SSE2)
+    __m128 centerX = _mm_set1_ps(x);
+    __m128 centerY = _mm_set1_ps(y);
+    __m128 radiusSquared = _mm_set1_ps(radius * radius);
+#endif
+
+    for (int base = 0; base < count; base += 32) {
+        int end = count - base < 32 ? count : base + 32;
+        uint32_t word = 0;
+        int i = base;
+
+#if defined(PROXIMITY_AVX2)
+        for (; i + 8 <= end; i += 8) {
+            __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), centerX);
+            __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ys + i), centerY);
+            __m256 distance = _mm256_add_ps(_mm256_mul_ps(dx, dx),
+                                            _mm256_mul_ps(dy, dy));
+            __m256 limit = radiusSquared;
+            if (radii) {
+                __m256 r = _mm256_loadu_ps(radii + i);
+                limit = _mm256_mul_ps(r, r);
+            }
+            __m256 inside = _mm256_cmp_ps(distance, limit, _CMP_LE_OQ);
+            word |= (uint32_t)_mm256_movemask_ps(inside) << (i - base);
+        }
+#elif defined(PROXIMITY_SSE2)
+        for (; i + 4 <= end; i += 4) {
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i), centerX);
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + i), centerY);
+            __m128 distance =
+                _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            __m128 limit = radiusSquared;
+            if (radii) {
+                __m128 r = _mm_loadu_ps(radii + i);
+                limit = _mm_mul_ps(r, r);
+            }
+            __m128 inside = _mm_cmple_ps(distance, limit);
+            word |= (uint32_t)_mm_movemask_ps(inside) << (i - base);
+        }
+#endif
+
+        for (; i < end; i++) {
+            float dx = xs[i] - x;
+            float dy = ys[i] - y;
+            float r = radii ? radii[i] : radius;
+            word |= (uint32_t)(dx * dx + dy * dy <= r * r) << (i - base);
+        }
+
+        hits[base / 32] = word;
+        hitCount += countBits(word);
+    }
+    return hitCount;
+}
+
+// Check points against one radius
+int proximityQuery(const float* xs, const float* ys, int count, float x,
+                   float y, float radius, uint32_t* hits) {
+    return proximityKernel(xs, ys, NULL, radius, count, x, y, hits);
+}
+
+// Check points against a radius each
+int proximityQueryEach(const float* xs, const float* ys, const float* radii,
+                       int count, float x, float y, uint32_t* hits) {
+    return proximityKernel(xs, ys, radii, 0.0f, count, x, y, hits);
+}
@@ -0,0 +1,341 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                        File: replay.c                        *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Recording and playing back replays. See replay.h for the journal format.
+
+// Includes
+#include "replay.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char magic[4] = {'S', 'V', 'S', 'R'};
+
+// Writing
+
+static void writeVarint(FILE* file, unsigned int value) {
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7f) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+static void writeU32(FILE* file, unsigned int value) {
+    for (int i = 0; i < 4; i++) {
+        fputc((int)(value >> (i * 8)) & 0xff, file);
+    }
+}
+
+// The client fields the game logic reads, in one byte
+static int clientFlags(const Client* client) {
+    return (client->acceptedFeatures & 0x7f) | client->udpActive << 7;
+}
+
+// Hooks do nothing while a replay is being played
+static bool recording(const Replay* self) { return !self->playing; }
+
+// Start recording to a file, from the state the game is in now
+Replay* replayRecord(const char* path, const GameState* state) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        perror(path);
+        return NULL;
+    }
+
+    Replay* self = (Replay*)malloc(sizeof(Replay));
+    memset(self, 0, sizeof(Replay));
+    self->file = file;
+    self->player = state->thisPlayer;
+    self->lobby = state->lobby;
+    self->tickMilliseconds = (int)lround(state->tickLength * 1000.0);
+    // A client starts with no features, and so does the one playing back
+    self->flags = 0;
+
+    fwrite(magic, 1, sizeof(magic), file);
+    fputc(REPLAY_VERSION, file);
+    fputc(self->player, file);
+    writeVarint(file, (unsigned int)self->lobby);
+    fputc(self->tickMilliseconds, file);
+
+    // Digest of where the game starts, so a different room file is caught
+    // before the first tick
+    replayRecordDigest(self, state);
+    return self;
+}
+
+// Called at the start of every tick, with its input
+void replayRecordTick(Replay* self, const Client* client, int input) {
+    if (!recording(self)) return;
+    replayRecordClient(self, client);
+    fputc('K', self->file);
+    fputc(input, self->file);
+}
+
+// Called for every action
+void replayRecordAction(Replay* self, Action action) {
+    if (!recording(self) || action == ACTION_NONE) return;
+    fputc('A', self->file);
+    fputc(action, self->file);
+}
+
+// Called for every message run
+void replayRecordMessage(Replay* self, const ClientMessage* message) {
+    if (!recording(self)) return;
+    fputc('M', self->file);
+    fputc(message->protocol, self->file);
+    writeVarint(self->file, (unsigned int)message->length);
+    fwrite(message->data, 1, message->length, self->file);
+    // Played back messages point into the journal, and text messages have
+    // to end in a null terminator
+    fputc(0, self->file);
+}
+
+// Called once the client has no messages left this tick, and before each
+// tick. Only changes are recorded.
+void replayRecordClient(Replay* self, const Client* client) {
+    if (!recording(self) || clientFlags(client) == self->flags) return;
+    self->flags = clientFlags(client);
+    fputc('F', self->file);
+    fputc(self->flags, self->file);
+}
+
+// Called at the end of every tick
+void replayRecordDigest(Replay* self, const GameState* state) {
+    if (!recording(self) || state->tick % REPLAY_DIGEST_TICKS != 0) return;
+    fputc('D', self->file);
+    writeVarint(self->file, state->tick);
+    writeU32(self->file, replayDigest(state));
+    // Keep the file up to date, so a crash still leaves a replay up to
+    // the last second
+    fflush(self->file);
+}
+
+// Reading
+
+static bool readByte(Replay* self, int* out) {
+    if (self->offset >= self->size) return false;
+    *out = self->data[self->offset++];
+    return true;
+}
+
+static bool readVarint(Replay* self, unsigned int* out) {
+    *out = 0;
+    for (int shift = 0; shift < 32; shift += 7) {
+        int byte;
+        if (!readByte(self, &byte)) return false;
+        *out |= (unsigned int)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static bool readU32(Replay* self, unsigned int* out) {
+    *out = 0;
+    for (int i = 0; i < 4; i++) {
+        int byte;
+        if (!readByte(self, &byte)) return false;
+        *out |= (unsigned int)byte << (i * 8);
+    }
+    return true;
+}
+
+// Load a journal to play back
+Replay* replayLoad(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return NULL;
+    }
+
+    // Read it all at once. Messages are played back from where they are.
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char* data = (unsigned char*)malloc(size > 0 ? size : 1);
+    bool read = size > 0 && fread(data, 1, size, file) == (size_t)size;
+    fclose(file);
+
+    Replay* self = (Replay*)malloc(sizeof(Replay));
+    memset(self, 0, sizeof(Replay));
+    self->playing = true;
+    self->data = data;
+    self->size = read ? (size_t)size : 0;
+
+    // Header
+    int version, player, tickMilliseconds;
+    unsigned int lobby;
+    bool valid = self->size >= sizeof(magic) &&
+                 memcmp(data, magic, sizeof(magic)) == 0;
+    self->offset = sizeof(magic);
+    valid = valid && readByte(self, &version) && version == REPLAY_VERSION &&
+            readByte(self, &player) && player < 2 &&
+            readVarint(self, &lobby) && readByte(self, &tickMilliseconds) &&
+            tickMilliseconds > 0;
+    if (!valid) {
+        printf("%s: not a replay, or from another version\n", path);
+        replayClose(self);
+        return NULL;
+    }
+
+    self->player = player;
+    self->lobby = (int)lobby;
+    self->tickMilliseconds = tickMilliseconds;
+    return self;
+}
+
+// Finish recording (or playing) and free the replay
+void replayClose(Replay* self) {
+    if (self->file) {
+        fclose(self->file);
+    }
+    free(self->data);
+    free(self);
+}
+
+// Set the client fields the game logic reads
+static void applyFlags(Client* client, int flags) {
+    client->acceptedFeatures = flags & 0x7f;
+    client->udpActive = flags >> 7;
+}
+
+// Playback: the next message recorded in this tick
+bool replayNextMessage(Replay* self, Client* client, ClientMessage* message) {
+    while (self->offset < self->size) {
+        size_t start = self->offset;
+        int tag = self->data[self->offset++];
+        int value;
+        unsigned int length;
+
+        if (tag == 'F' && readByte(self, &value)) {
+            applyFlags(client, value);
+        } else if (tag == 'M' && readByte(self, &value) &&
+                   readVarint(self, &length) &&
+                   self->size - self->offset > length) {
+            message->data = (char*)self->data + self->offset;
+            message->length = (int)length;
+            message->protocol = value;
+            // Skip the bytes and the null terminator
+            self->offset += length + 1;
+            return true;
+        } else if (tag == 'F' || tag == 'M') {
+            // Cut off at the end of the file
+            self->offset = self->size;
+            return false;
+        } else {
+            // The next tick, or something else. replayPlay deals with it.
+            self->offset = start;
+            return false;
+        }
+    }
+    return false;
+}
+
+// Play the whole journal on a new game state
+int replayPlay(Replay* self, Client* client, GameState* state) {
+    Player* player = &state->players[state->thisPlayer];
+    Player* other = &state->players[!state->thisPlayer];
+    state->replay = self;
+    state->tickLength = self->tickMilliseconds / 1000.0;
+
+    int tag;
+    while (readByte(self, &tag)) {
+        int value;
+        unsigned int tick, digest;
+
+        switch (tag) {
+            case 'K':
+                if (!readByte(self, &value)) break;
+                runGameLogic(client, state, player, other, value,
+                             state->tickLength);
+                continue;
+
+            case 'A':
+                if (!readByte(self, &value)) break;
+                onAction(client, state, (Action)value, player, other);
+                continue;
+
+            case 'F':
+                if (!readByte(self, &value)) break;
+                applyFlags(client, value);
+                continue;
+
+            case 'D':
+                if (!readVarint(self, &tick) || !readU32(self, &digest)) break;
+                self->digests++;
+                if (tick != state->tick || digest != replayDigest(state)) {
+                    // Everything after the first difference is likely to
+                    // differ too, so only it is reported
+                    if (!self->desyncs) {
+                        printf("Replay went differently at tick %u\n", tick);
+                    }
+                    self->desyncs++;
+                }
+                continue;
+
+            default:
+                // Messages are read by the tick they're in, so one here
+                // means the journal is damaged
+                printf("Damaged replay at byte %zu\n", self->offset - 1);
+                return -1;
+        }
+
+        // A record was cut off, by the game stopping while it was written.
+        // Everything before it was played.
+        break;
+    }
+    return self->desyncs;
+}
+
+// FNV-1a, over the bytes of each value
+static unsigned int hashBytes(unsigned int hash, const void* data,
+                              size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+#define HASH(hash, value) hashBytes(hash, &(value), sizeof(value))
+
+// Hash of the game state that playback has to reproduce
+unsigned int replayDigest(const GameState* state) {
+    unsigned int hash = 2166136261u;
+
+    for (int i = 0; i < 2; i++) {
+        const Player* player = &state->players[i];
+        hash = HASH(hash, player->pos.x);
+        hash = HASH(hash, player->pos.y);
+        hash = HASH(hash, player->facing);
+        hash = HASH(hash, player->room);
+        hash = HASH(hash, player->health);
+        hash = HASH(hash, player->foodInventory);
+    }
+
+    // Traps in slot order. Slots are given out and swapped in the order
+    // commands arrive, so they're the same on playback.
+    const TrapTable* traps = &state->traps;
+    hash = HASH(hash, traps->count);
+    hash = hashBytes(hash, traps->id, traps->count * sizeof(int));
+    hash = hashBytes(hash, traps->data, traps->count * sizeof(int));
+    hash = hashBytes(hash, traps->owner, traps->count * sizeof(int));
+    hash = hashBytes(hash, traps->room, traps->count * sizeof(int));
+    hash = hashBytes(hash, traps->x, traps->count * sizeof(float));
+    hash = hashBytes(hash, traps->y, traps->count * sizeof(float));
+
+    hash = hashBytes(hash, state->furniture.food,
+                     state->furniture.count * sizeof(FoodData));
+    hash = HASH(hash, state->trapInventory);
+    hash = HASH(hash, state->exitUnlocked);
+    hash = HASH(hash, state->gameStarted);
+    hash = HASH(hash, state->done);
+    return hash;
+}
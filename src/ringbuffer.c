@@ -0,0 +1,125 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                      File: ringbuffer.c                      *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// The ring buffer sits between the recieving thread (producer) and the game
+// thread (consumer). Neither side takes a lock: the producer publishes new
+// bytes by storing head with release ordering, and the consumer hands space
+// back by storing tail with release ordering. Each side loads the other's
+// counter with acquire ordering so the bytes are visible before the counter.
+
+// Includes
+#include "ringbuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Allocate ring buffer storage. Capacity must be a power of two.
+bool ringInit(RingBuffer *self, size_t capacity) {
+    // Masking only works for powers of two
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+
+    self->data = (char *)calloc(capacity, sizeof(char));
+    if (!self->data) {
+        return false;
+    }
+
+    self->capacity = capacity;
+    self->mask = capacity - 1;
+    atomic_init(&self->head, 0);
+    atomic_init(&self->tail, 0);
+    return true;
+}
+
+// Free ring buffer storage
+void ringFree(RingBuffer *self) {
+    free(self->data);
+    self->data = NULL;
+    self->capacity = 0;
+    self->mask = 0;
+}
+
+// Producer: get a pointer to contiguous free space.
+char *ringWritePtr(RingBuffer *self, size_t *space) {
+    // The producer owns head, so a relaxed load is enough
+    size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+
+    // Free bytes in total, and free bytes before the end of the storage
+    size_t available = self->capacity - (head - tail);
+    size_t untilEnd = self->capacity - (head & self->mask);
+
+    *space = available < untilEnd ? available : untilEnd;
+    return self->data + (head & self->mask);
+}
+
+// Producer: publish bytes written through ringWritePtr
+void ringCommitWrite(RingBuffer *self, size_t length) {
+    size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+    atomic_store_explicit(&self->head, head + length, memory_order_release);
+}
+
+// Producer: copy bytes in, splitting the copy in two if it wraps around.
+bool ringWrite(RingBuffer *self, const char *data, size_t length) {
+    size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+
+    // All or nothing
+    if (self->capacity - (head - tail) < length) {
+        return false;
+    }
+
+    size_t start = head & self->mask;
+    size_t first = self->capacity - start;
+    if (first >= length) {
+        memcpy(self->data + start, data, length);
+    } else {
+        memcpy(self->data + start, data, first);
+        memcpy(self->data, data + first, length - first);
+    }
+
+    atomic_store_explicit(&self->head, head + length, memory_order_release);
+    return true;
+}
+
+// Consumer: number of bytes waiting to be read
+size_t ringReadable(RingBuffer *self) {
+    size_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    return head - tail;
+}
+
+// Consumer: get a pointer into the readable bytes.
+char *ringReadPtr(RingBuffer *self, size_t offset, size_t *contiguous) {
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    size_t start = (tail + offset) & self->mask;
+    *contiguous = self->capacity - start;
+    return self->data + start;
+}
+
+// Consumer: copy bytes out, splitting the copy in two if it wraps around.
+void ringCopyOut(RingBuffer *self, size_t offset, char *dst, size_t length) {
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    size_t start = (tail + offset) & self->mask;
+    size_t first = self->capacity - start;
+
+    if (first >= length) {
+        memcpy(dst, self->data + start, length);
+    } else {
+        memcpy(dst, self->data + start, first);
+        memcpy(dst + first, self->data, length - first);
+    }
+}
+
+// Consumer: release bytes back to the producer
+void ringConsume(RingBuffer *self, size_t length) {
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    atomic_store_explicit(&self->tail, tail + length, memory_order_release);
+}
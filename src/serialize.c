@@ -0,0 +1,209 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                       File: serialize.c                      *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Writing the game state as bytes and reading it back. See serialize.h for
+// the layout.
+
+// Includes
+#include "serialize.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// Writes little-endian values, and counts how many bytes were needed even
+// when they don't fit
+typedef struct {
+    unsigned char* p;
+    int size;
+    int length;
+} Writer;
+
+static void writeByte(Writer* out, int value) {
+    if (out->length < out->size) {
+        out->p[out->length] = (unsigned char)value;
+    }
+    out->length++;
+}
+
+static void writeU16(Writer* out, int value) {
+    writeByte(out, value & 0xff);
+    writeByte(out, (value >> 8) & 0xff);
+}
+
+static void writeF32(Writer* out, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    writeU16(out, bits & 0xffff);
+    writeU16(out, bits >> 16);
+}
+
+// Reads little-endian values. The length is checked before reading.
+static int readByte(const unsigned char** p) { return *(*p)++; }
+
+static int readU16(const unsigned char** p) {
+    int low = readByte(p);
+    return low | readByte(p) << 8;
+}
+
+static float readF32(const unsigned char** p) {
+    uint32_t bits = (uint32_t)readU16(p);
+    bits |= (uint32_t)readU16(p) << 16;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Write the game state
+int serializeGameState(const GameState* state, char* out, int size) {
+    Writer writer = {(unsigned char*)out, size, 0};
+
+    writeByte(&writer, GAMESTATE_VERSION);
+    writeByte(&writer, state->exitUnlocked);
+
+    for (int i = 0; i < 2; i++) {
+        const Player* player = &state->players[i];
+        int food = 0;
+        for (int item = 0; item < FOOD_COUNT; item++) {
+            food |= player->foodInventory[item] << item;
+        }
+        writeF32(&writer, player->pos.x);
+        writeF32(&writer, player->pos.y);
+        writeU16(&writer, player->room);
+        writeByte(&writer, player->facing);
+        writeByte(&writer, food);
+    }
+
+    writeByte(&writer, furnitureCount(state));
+    for (int i = 0; i < furnitureCount(state); i++) {
+        writeByte(&writer, furnitureFood(state, i));
+    }
+
+    writeU16(&writer, trapCount(state));
+    for (int i = 0; i < trapCount(state); i++) {
+        Position pos = trapPos(state, i);
+        writeU16(&writer, trapId(state, i));
+        writeByte(&writer, trapOwner(state, i));
+        writeByte(&writer, trapData(state, i));
+        writeU16(&writer, trapRoom(state, i));
+        writeF32(&writer, pos.x);
+        writeF32(&writer, pos.y);
+    }
+
+    return writer.length <= size ? writer.length : -1;
+}
+
+// Check a position is in a room. Written so NaN fails.
+static bool validPosition(float x, float y) {
+    return x >= 0.0f && x <= SCREEN_W && y >= 0.0f && y <= SCREEN_H;
+}
+
+// Check every value before anything is changed. The length was already
+// checked against the counts.
+static bool validGameState(const GameState* state, const unsigned char* p,
+                           int trapCount) {
+    p += GAMESTATE_HEADER_SIZE;
+    for (int i = 0; i < 2; i++) {
+        float x = readF32(&p);
+        float y = readF32(&p);
+        int room = readU16(&p);
+        int facing = readByte(&p);
+        int food = readByte(&p);
+        if (!validPosition(x, y) || room >= houseRooms(state) || facing >= 4 ||
+            food >> FOOD_COUNT) {
+            return false;
+        }
+    }
+
+    p++;
+    for (int i = 0; i < furnitureCount(state); i++) {
+        if (readByte(&p) > FOOD_COUNT) return false;
+    }
+
+    // IDs have to be unique, or the trap table would refuse them
+    uint32_t seen[65536 / 32] = {0};
+    p += 2;
+    for (int i = 0; i < trapCount; i++) {
+        int id = readU16(&p);
+        int owner = readByte(&p);
+        int data = readByte(&p);
+        int room = readU16(&p);
+        float x = readF32(&p);
+        float y = readF32(&p);
+        if (seen[id / 32] & 1u << id % 32 || owner >= 2 ||
+            data <= TRAP_NONE || data > TRAP_COUNT ||
+            room >= houseRooms(state) || !validPosition(x, y)) {
+            return false;
+        }
+        seen[id / 32] |= 1u << id % 32;
+    }
+    return true;
+}
+
+// Replace the shared parts of the game state
+bool deserializeGameState(GameState* state, const char* data, int length) {
+    const unsigned char* p = (const unsigned char*)data;
+
+    // The length follows from the furniture and trap counts
+    int furniture = GAMESTATE_HEADER_SIZE + 2 * GAMESTATE_PLAYER_SIZE;
+    if (length < furniture + 1 || p[0] != GAMESTATE_VERSION ||
+        p[furniture] != furnitureCount(state)) {
+        return false;
+    }
+    int traps = furniture + 1 + furnitureCount(state);
+    if (length < traps + 2) {
+        return false;
+    }
+    int count = p[traps] | p[traps + 1] << 8;
+    if (count > TRAP_MAX ||
+        length != traps + 2 + count * GAMESTATE_TRAP_SIZE ||
+        !validGameState(state, p, count)) {
+        return false;
+    }
+
+    p++;
+    state->exitUnlocked = readByte(&p);
+
+    for (int i = 0; i < 2; i++) {
+        Player* player = &state->players[i];
+        player->pos.x = readF32(&p);
+        player->pos.y = readF32(&p);
+        player->room = readU16(&p);
+        player->facing = readByte(&p);
+        int food = readByte(&p);
+        for (int item = 0; item < FOOD_COUNT; item++) {
+            player->foodInventory[item] = food >> item & 1;
+        }
+    }
+
+    // Food left in each piece of furniture. The rooms count it again.
+    p++;
+    for (int i = 0; i < furnitureCount(state); i++) {
+        state->furniture.food[i] = (FoodData)readByte(&p);
+    }
+    indexFurniture(state);
+
+    // The traps, in the same order. A trap of each kind this player has
+    // placed is out of their inventory until it's set off.
+    p += 2;
+    memset(&state->traps, 0, sizeof(state->traps));
+    memset(state->trapInventory, true, sizeof(state->trapInventory));
+    for (int i = 0; i < count; i++) {
+        int id = readU16(&p);
+        int owner = readByte(&p);
+        int trap = readByte(&p);
+        int room = readU16(&p);
+        float x = readF32(&p);
+        float y = readF32(&p);
+        trapTableAdd(&state->traps, id, trap, owner, room, x, y);
+        if (owner == state->thisPlayer) {
+            state->trapInventory[trap - 1] = false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,228 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                         File: traps.c                        *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Trap storage and the spatial index. Traps are packed at the front of the
+// table and IDs are found by hashing, so placing and removing a trap never
+// searches the slots. Traps are also kept in lists per room and per grid
+// cell, so collisions and drawing only look at traps that could matter.
+
+// Includes
+#include "traps.h"
+
+// Where an ID's probe starts. The server hands out IDs in order, so the low
+// bits spread them out already.
+static int lookupHome(int id) { return id & (TRAP_LOOKUP_SIZE - 1); }
+
+static int lookupNext(int i) { return (i + 1) & (TRAP_LOOKUP_SIZE - 1); }
+
+// Find the lookup entry for an ID, or the empty entry where it would go
+static int lookupEntry(const TrapLookup* self, int id) {
+    int i = lookupHome(id);
+    while (self->slot[i] && self->id[i] != id) {
+        i = lookupNext(i);
+    }
+    return i;
+}
+
+// Take an entry out of the lookup
+static void lookupRemove(TrapLookup* self, int entry) {
+    // Close the gap, so probes for the entries after it still reach them.
+    // An entry moves back into the gap unless its probe starts between the
+    // gap and where it is now.
+    int gap = entry;
+    for (int i = lookupNext(gap); self->slot[i]; i = lookupNext(i)) {
+        int home = lookupHome(self->id[i]);
+        bool between = gap <= i ? (gap < home && home <= i)
+                                : (gap < home || home <= i);
+        if (!between) {
+            self->id[gap] = self->id[i];
+            self->slot[gap] = self->slot[i];
+            gap = i;
+        }
+    }
+    self->slot[gap] = 0;
+}
+
+// Add a slot to the front of a list
+static void listInsert(int* first, int* next, int* prev, int slot) {
+    next[slot] = *first;
+    prev[slot] = 0;
+    if (*first) {
+        prev[*first - 1] = slot + 1;
+    }
+    *first = slot + 1;
+}
+
+// Take a slot out of a list
+static void listRemove(int* first, int* next, int* prev, int slot) {
+    if (prev[slot]) {
+        next[prev[slot] - 1] = next[slot];
+    } else {
+        *first = next[slot];
+    }
+    if (next[slot]) {
+        prev[next[slot] - 1] = prev[slot];
+    }
+}
+
+// Point a list at a slot's new place, after it's moved from one slot to
+// another
+static void listMove(int* first, int* next, int* prev, int from, int to) {
+    next[to] = next[from];
+    prev[to] = prev[from];
+    if (prev[to]) {
+        next[prev[to] - 1] = to + 1;
+    } else {
+        *first = to + 1;
+    }
+    if (next[to]) {
+        prev[next[to] - 1] = to + 1;
+    }
+}
+
+// Grid column or row of a coordinate. Anything off the edge of the room
+// goes in the nearest cell.
+static int gridIndex(float value, int size) {
+    if (value < 0.0f) return 0;
+    int i = (int)(value / TRAP_CELL_SIZE);
+    return i < size ? i : size - 1;
+}
+
+// Cell of a position, counting across all rooms
+static int gridCell(int room, int column, int row) {
+    return room * TRAP_GRID_CELLS + row * TRAP_GRID_W + column;
+}
+
+// Lists a room and a cell are in. Neighbouring rooms and cells are in
+// different lists.
+static int roomList(int room) { return room & (TRAP_ROOM_LISTS - 1); }
+
+static int cellList(int cell) { return cell & (TRAP_CELL_LISTS - 1); }
+
+static int slotRoom(const TrapGrid* self, int slot) {
+    return self->cell[slot] / TRAP_GRID_CELLS;
+}
+
+// Add the trap in a slot to the grid
+static void gridAdd(TrapGrid* self, int slot, int room, float x, float y) {
+    int cell = gridCell(room, gridIndex(x, TRAP_GRID_W),
+                        gridIndex(y, TRAP_GRID_H));
+    self->cell[slot] = cell;
+    listInsert(&self->roomFirst[roomList(room)], self->roomNext,
+               self->roomPrev, slot);
+    listInsert(&self->cellFirst[cellList(cell)], self->cellNext,
+               self->cellPrev, slot);
+}
+
+// Take the trap in a slot out of the grid
+static void gridRemove(TrapGrid* self, int slot) {
+    listRemove(&self->roomFirst[roomList(slotRoom(self, slot))],
+               self->roomNext, self->roomPrev, slot);
+    listRemove(&self->cellFirst[cellList(self->cell[slot])], self->cellNext,
+               self->cellPrev, slot);
+}
+
+// Move the trap in one slot to another, keeping its place in the lists
+static void gridMove(TrapGrid* self, int from, int to) {
+    self->cell[to] = self->cell[from];
+    listMove(&self->roomFirst[roomList(slotRoom(self, to))], self->roomNext,
+             self->roomPrev, from, to);
+    listMove(&self->cellFirst[cellList(self->cell[to])], self->cellNext,
+             self->cellPrev, from, to);
+}
+
+// The first trap in a room from a link in its list, skipping traps from
+// other rooms in the same list
+static int roomFrom(const TrapGrid* self, int link, int room) {
+    while (link && slotRoom(self, link - 1) != room) {
+        link = self->roomNext[link - 1];
+    }
+    return link - 1;
+}
+
+// First trap in a room
+int trapGridRoomFirst(const TrapGrid* self, int room) {
+    return roomFrom(self, self->roomFirst[roomList(room)], room);
+}
+
+// Next trap in the same room
+int trapGridRoomNext(const TrapGrid* self, int slot) {
+    return roomFrom(self, self->roomNext[slot], slotRoom(self, slot));
+}
+
+// Find the traps in cells within radius of a position
+int trapGridQuery(const TrapGrid* self, int room, float x, float y,
+                  float radius, int* slots, int max) {
+    int left = gridIndex(x - radius, TRAP_GRID_W);
+    int right = gridIndex(x + radius, TRAP_GRID_W);
+    int top = gridIndex(y - radius, TRAP_GRID_H);
+    int bottom = gridIndex(y + radius, TRAP_GRID_H);
+
+    int count = 0;
+    for (int row = top; row <= bottom; row++) {
+        for (int column = left; column <= right; column++) {
+            int cell = gridCell(room, column, row);
+            for (int link = self->cellFirst[cellList(cell)];
+                 link && count < max; link = self->cellNext[link - 1]) {
+                if (self->cell[link - 1] == cell) {
+                    slots[count++] = link - 1;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+// Add a trap
+int trapTableAdd(TrapTable* self, int id, int data, int owner, int room,
+                 float x, float y) {
+    int entry = lookupEntry(&self->lookup, id);
+    if (self->lookup.slot[entry] || self->count >= TRAP_MAX) {
+        return -1;
+    }
+
+    // New traps go on the end
+    int slot = self->count++;
+    self->x[slot] = x;
+    self->y[slot] = y;
+    self->room[slot] = room;
+    self->data[slot] = data;
+    self->owner[slot] = owner;
+    self->id[slot] = id;
+
+    self->lookup.id[entry] = id;
+    self->lookup.slot[entry] = slot + 1;
+    gridAdd(&self->grid, slot, room, x, y);
+    return slot;
+}
+
+// Find the slot of a trap ID
+int trapTableFind(const TrapTable* self, int id) {
+    return self->lookup.slot[lookupEntry(&self->lookup, id)] - 1;
+}
+
+// Remove the trap in a slot
+void trapTableRemove(TrapTable* self, int slot) {
+    lookupRemove(&self->lookup, lookupEntry(&self->lookup, self->id[slot]));
+    gridRemove(&self->grid, slot);
+
+    // Fill the hole with the last trap, so the live traps stay packed
+    int last = --self->count;
+    if (slot == last) {
+        return;
+    }
+    self->x[slot] = self->x[last];
+    self->y[slot] = self->y[last];
+    self->room[slot] = self->room[last];
+    self->data[slot] = self->data[last];
+    self->owner[slot] = self->owner[last];
+    self->id[slot] = self->id[last];
+    self->lookup.slot[lookupEntry(&self->lookup, self->id[slot])] = slot + 1;
+    gridMove(&self->grid, last, slot);
+}
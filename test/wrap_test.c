@@ -0,0 +1,75 @@
+/****************************************************************
+ *  Name: Olivier Audet-Yang        ICS3U        May-June 2024  *
+ *                                                              *
+ *                       File: wrap_test.c                      *
+ *                                                              *
+ *  Source code for Squirrel vs Squirrel, a squirrel themed     *
+ *  and multiplayer Spy vs Spy.                                 *
+ ****************************************************************/
+
+// Checks that messages which wrap around the end of their queue stay
+// intact until the batch they're in is finished. A position from the TCP
+// queue and a facing from the datagram queue both wrap, and are both held
+// by run_messages until the end of the batch.
+//
+// Exits with 1 if either message was damaged.
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+
+#include "client.h"
+#include "commands.h"
+#include "game.h"
+
+// Small queues, so a message can be made to wrap
+#define TEST_QUEUE_SIZE 64
+
+// Write a frame to a queue so it wraps: skip bytes are written and read
+// first, which leaves the frame's payload split by the end of the queue
+static void writeWrapped(MessageQueue *queue, int skip,
+                         const unsigned char *frame, int length) {
+    char filler[TEST_QUEUE_SIZE] = {0};
+    ringWrite(&queue->ring, filler, skip);
+    ringConsume(&queue->ring, skip);
+    ringWrite(&queue->ring, (const char *)frame, length);
+}
+
+int main(void) {
+    static GameState state;
+    memset(&state, 0, sizeof(GameState));
+    state.houseW = HOUSE_W;
+    state.houseH = HOUSE_H;
+    state.players[0].health = 100.0f;
+    state.players[1].health = 100.0f;
+
+    // A client that was never connected, reading the binary protocol
+    Client *client = clientInit();
+    client->recvProtocol = PROTOCOL_BINARY;
+    if (!ringInit(&client->queue.ring, TEST_QUEUE_SIZE) ||
+        !ringInit(&client->datagrams.ring, TEST_QUEUE_SIZE)) {
+        fprintf(stderr, "Failed to allocate queues\n");
+        return 1;
+    }
+
+    // Player 1 at (100, 200), in 1/32 pixels, over TCP. The payload starts
+    // at byte 62 of 64.
+    const unsigned char position[] = {6, 0, 'P', 1, 0x80, 0x0c, 0x00, 0x19};
+    writeWrapped(&client->queue, 60, position, sizeof(position));
+    // Player 1 facing right, over UDP. The payload starts at byte 62 too.
+    const unsigned char facing[] = {3, 0, 'F', 1, 3};
+    writeWrapped(&client->datagrams, 60, facing, sizeof(facing));
+
+    int result = run_messages(client, &state);
+    Player *player = &state.players[1];
+    bool passed = result == 0 && player->pos.x == 100.0f &&
+                  player->pos.y == 200.0f && player->facing == 3;
+    printf("%s: result %d, position (%.1f, %.1f), facing %d\n",
+           passed ? "passed" : "FAILED", result, player->pos.x,
+           player->pos.y, player->facing);
+
+    ringFree(&client->queue.ring);
+    ringFree(&client->datagrams.ring);
+    clientFree(client);
+    return !passed;
+}